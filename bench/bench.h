@@ -0,0 +1,59 @@
+#ifndef C6502_BENCH_H
+#define C6502_BENCH_H
+
+#include <stdio.h>
+#include "../src/6502.h"
+
+/*
+ * BENCHMARKS
+ *
+ * A workload is a straight run of code loaded at BENCH_START. Each engine
+ * runs it end to end, from the same registers, over and over until
+ * BENCH_SECONDS have passed.
+ */
+
+#define BENCH_START 0x1000
+#define BENCH_CODE_SIZE 0x1000
+#define BENCH_SECONDS 0.03 // Per run
+#define BENCH_PASSES 16 // Passes between clock reads, also the warm-up
+#define BENCH_RUNS 10 // Default runs of each workload
+#define BENCH_MAX_RUNS 32
+#define BENCH_MAX_RESULTS 256
+#define BENCH_THRESHOLD 5.0 // Default slowdown, in percent, that fails a comparison
+
+typedef enum {
+  ENGINE_EXECUTE,
+  ENGINE_DECODED,
+  ENGINE_JIT,
+#ifdef BATCH_ENGINE
+  ENGINE_BATCH, // BATCH_LANES copies of the workload in lockstep
+#endif
+  ENGINES
+} Engine;
+
+typedef struct {
+  const char *name;
+  void (*load)(Machine *machine); // Writes code and data, sets the registers
+} Workload;
+
+typedef struct {
+  const char *workload;
+  const char *engine;
+  double instructions;
+  double cycles;
+  double seconds; // Totals over all runs
+  uint runs;
+  double samples[BENCH_MAX_RUNS]; // Instructions per second of each run
+} BenchResult;
+
+extern const Workload workloads[];
+extern const uint workloadCount;
+extern const char * const engineNames[ENGINES];
+
+double now();
+void runWorkload(const Workload *workload, Engine engine, BenchResult *result);
+void writeResult(FILE *out, const BenchResult *result);
+void writeResetResults(FILE *out);
+int compareResults(const char *path, const BenchResult *results, uint count, double threshold);
+
+#endif
@@ -0,0 +1,158 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/*
+ * Baseline comparison
+ *
+ * Reads the samples of a previous results file and compares them to the
+ * current ones with Welch's t-test. A workload regresses when its mean
+ * throughput drops by more than the threshold and the drop is significant
+ * at the 1% level, so noisy runs don't fail the check on their own.
+ */
+
+#define BASELINE_LINE_SIZE 1024
+
+typedef struct {
+  char workload[32];
+  char engine[16];
+  uint runs;
+  double samples[BENCH_MAX_RUNS];
+} BaselineEntry;
+
+static BaselineEntry baseline[BENCH_MAX_RESULTS];
+
+// One-sided 99% critical values of Student's t, by degrees of freedom. The
+// 1% level keeps false alarms rare over dozens of workloads.
+static const double criticalValues[] = {
+  0, 31.821, 6.965, 4.541, 3.747, 3.365, 3.143, 2.998, 2.896, 2.821, 2.764,
+  2.718, 2.681, 2.650, 2.624, 2.602, 2.583, 2.567, 2.552, 2.539, 2.528,
+  2.518, 2.508, 2.500, 2.492, 2.485, 2.479, 2.473, 2.467, 2.462, 2.457,
+};
+
+static double criticalValue(double df) {
+  uint rounded = df < 1 ? 1 : (uint)df;
+  if(rounded < sizeof(criticalValues) / sizeof(criticalValues[0]))
+    return criticalValues[rounded];
+  return 2.326;
+}
+
+static void statistics(const double *samples, uint runs, double *mean, double *variance) {
+  *mean = 0;
+  for(uint i = 0; i < runs; i++) {
+    *mean += samples[i];
+  }
+  *mean /= runs;
+
+  *variance = 0;
+  for(uint i = 0; i < runs; i++) {
+    *variance += (samples[i] - *mean) * (samples[i] - *mean);
+  }
+  *variance = runs > 1 ? *variance / (runs - 1) : 0;
+}
+
+// Whether the current samples are significantly slower than the baseline
+static byte slower(const BaselineEntry *before, const BenchResult *after, double *t) {
+  double meanBefore, varianceBefore, meanAfter, varianceAfter;
+  statistics(before->samples, before->runs, &meanBefore, &varianceBefore);
+  statistics(after->samples, after->runs, &meanAfter, &varianceAfter);
+
+  double errorBefore = varianceBefore / before->runs;
+  double errorAfter = varianceAfter / after->runs;
+  double error = errorBefore + errorAfter;
+  if(error == 0) {
+    *t = 0;
+    return meanAfter < meanBefore;
+  }
+
+  *t = (meanAfter - meanBefore) / sqrt(error);
+
+  // Welch-Satterthwaite degrees of freedom
+  double df = error * error / (
+    (before->runs > 1 ? errorBefore * errorBefore / (before->runs - 1) : 0) +
+    (after->runs > 1 ? errorAfter * errorAfter / (after->runs - 1) : 0));
+  return *t < -criticalValue(df);
+}
+
+// Reads one workload line of a results file, returns 0 for any other line
+static byte parseEntry(const char *line, BaselineEntry *entry) {
+  const char *workload = strstr(line, "\"workload\": \"");
+  const char *engine = strstr(line, "\"engine\": \"");
+  const char *samples = strstr(line, "\"samples\": [");
+  if(workload == NULL || engine == NULL || samples == NULL)
+    return 0;
+  if(sscanf(workload, "\"workload\": \"%31[^\"]\"", entry->workload) != 1 ||
+      sscanf(engine, "\"engine\": \"%15[^\"]\"", entry->engine) != 1)
+    return 0;
+
+  char *cursor = (char *)samples + strlen("\"samples\": [");
+  entry->runs = 0;
+  while(entry->runs < BENCH_MAX_RUNS && *cursor != ']') {
+    char *end;
+    double sample = strtod(cursor, &end);
+    if(end == cursor)
+      break;
+    entry->samples[entry->runs++] = sample;
+    cursor = end;
+    while(*cursor == ',' || *cursor == ' ')
+      cursor++;
+  }
+  return entry->runs > 0;
+}
+
+static uint loadBaseline(FILE *file) {
+  char line[BASELINE_LINE_SIZE];
+  uint count = 0;
+
+  while(count < BENCH_MAX_RESULTS && fgets(line, sizeof(line), file) != NULL) {
+    if(parseEntry(line, &baseline[count]))
+      count++;
+  }
+  return count;
+}
+
+// Prints one line per workload to stderr, returns the number of regressions,
+// or -1 when the baseline can't be read
+int compareResults(const char *path, const BenchResult *results, uint count, double threshold) {
+  FILE *file = fopen(path, "r");
+  if(file == NULL) {
+    perror(path);
+    return -1;
+  }
+  uint entries = loadBaseline(file);
+  fclose(file);
+  if(entries == 0) {
+    fprintf(stderr, "%s: no results\n", path);
+    return -1;
+  }
+
+  int regressions = 0;
+  for(uint i = 0; i < count; i++) {
+    const BenchResult *result = &results[i];
+    const BaselineEntry *entry = NULL;
+    for(uint j = 0; j < entries && entry == NULL; j++) {
+      if(strcmp(baseline[j].workload, result->workload) == 0 &&
+          strcmp(baseline[j].engine, result->engine) == 0)
+        entry = &baseline[j];
+    }
+
+    fprintf(stderr, "%-10s %-8s ", result->workload, result->engine);
+    if(entry == NULL) {
+      fprintf(stderr, "not in baseline\n");
+      continue;
+    }
+
+    double before, after, variance, t;
+    statistics(entry->samples, entry->runs, &before, &variance);
+    statistics(result->samples, result->runs, &after, &variance);
+    double change = (after - before) * 100 / before;
+    byte significant = slower(entry, result, &t);
+    byte regressed = change < -threshold && significant;
+
+    fprintf(stderr, "%+7.2f%%  t=%+7.2f  %s\n", change, t,
+      regressed ? "REGRESSION" : "ok");
+    regressions += regressed;
+  }
+  return regressions;
+}
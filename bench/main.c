@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+
+/*
+ * Benchmark suite
+ *
+ * Runs every workload on every engine, then the reset benchmark, and writes
+ * the results as JSON to the file given as argument, or to stdout.
+ *
+ * Options:
+ *   --runs N          Runs of each workload, for the comparison (default 10)
+ *   --compare FILE    Compare to a previous results file, and exit with 1
+ *                     when any workload regressed
+ *   --threshold PCT   Slowdown that counts as a regression (default 5)
+ */
+
+static BenchResult results[BENCH_MAX_RESULTS];
+
+double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [--runs N] [--compare FILE] [--threshold PCT] [OUTPUT]\n", name);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  uint runs = BENCH_RUNS;
+  double threshold = BENCH_THRESHOLD;
+  const char *baseline = NULL;
+  const char *output = NULL;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+      runs = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+      baseline = argv[++i];
+    else if(strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+      threshold = atof(argv[++i]);
+    else if(argv[i][0] != '-' && output == NULL)
+      output = argv[i];
+    else
+      usage(argv[0]);
+  }
+  if(runs < 1 || runs > BENCH_MAX_RUNS)
+    usage(argv[0]);
+
+  FILE *out = stdout;
+  if(output != NULL && (out = fopen(output, "w")) == NULL) {
+    perror(output);
+    return 1;
+  }
+
+  // Runs go round all the workloads, so drift in the host's speed shows up
+  // as variance instead of favouring some workloads over others
+  uint count = 0;
+  for(uint run = 0; run < runs; run++) {
+    count = 0;
+    for(uint i = 0; i < workloadCount; i++) {
+      for(int engine = 0; engine < ENGINES && count < BENCH_MAX_RESULTS; engine++) {
+        runWorkload(&workloads[i], engine, &results[count++]);
+      }
+    }
+  }
+
+  fprintf(out, "{\n  \"workloads\": [\n");
+  for(uint i = 0; i < count; i++) {
+    fprintf(out, "    ");
+    writeResult(out, &results[i]);
+    fprintf(out, i + 1 < count ? ",\n" : "\n");
+  }
+  fprintf(out, "  ],\n  \"resets\": [\n");
+  writeResetResults(out);
+  fprintf(out, "  ]\n}\n");
+
+  if(out != stdout)
+    fclose(out);
+
+  if(baseline != NULL) {
+    int regressions = compareResults(baseline, results, count, threshold);
+    if(regressions != 0) {
+      if(regressions > 0)
+        fprintf(stderr, "%d workloads regressed by more than %.1f%%\n", regressions, threshold);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+#include "bench.h"
+
+/*
+ * Reset benchmark
+ *
+ * Measures resets per second of a full reset(), a registers-only
+ * resetCPU(), and the byte-at-a-time clear initMemory() used to do.
+ */
+
+#define RESETS 100000
+
+static Machine machine;
+
+// The previous reset: clears memory one byte at a time
+static void byteLoopReset(CPU *cpu, Memory *memory) {
+  resetCPU(cpu);
+  for(int i = 0; i < MEMORY_SIZE; i++) {
+    ((volatile byte *)memory->data)[i] = 0x00;
+  }
+  for(int i = 0; i < MEMORY_PAGES; i++) {
+    memory->codePages[i] = 0;
+    memory->codeGeneration[i] = 0;
+  }
+}
+
+static void report(FILE *out, const char *name, double seconds, const char *separator) {
+  fprintf(out, "    {\"name\": \"%s\", \"resets_per_second\": %.0f}%s\n",
+    name, RESETS / seconds, separator);
+}
+
+void writeResetResults(FILE *out) {
+  double start = now();
+  for(int i = 0; i < RESETS; i++) {
+    byteLoopReset(&machine.cpu, &machine.memory);
+  }
+  report(out, "byte loop", now() - start, ",");
+
+  start = now();
+  for(int i = 0; i < RESETS; i++) {
+    reset(&machine.cpu, &machine.memory);
+  }
+  report(out, "reset()", now() - start, ",");
+
+  start = now();
+  for(int i = 0; i < RESETS; i++) {
+    resetCPU(&machine.cpu);
+  }
+  report(out, "resetCPU()", now() - start, "");
+}
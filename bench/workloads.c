@@ -0,0 +1,219 @@
+#include "bench.h"
+#include "../src/batch.h"
+#include "../src/decode.h"
+#include "../src/jit.h"
+
+/*
+ * Workloads
+ *
+ * One load loop per opcode, built from the instruction list, and a mixed
+ * loop that cycles through all of them, in order and shuffled.
+ */
+
+#define BENCH_ZERO_PAGE 0x10
+#define BENCH_DATA 0x0300
+
+static const byte lengths[] = {
+#define BENCH_LENGTH(name, mode, reg) [OP_##name] = LENGTH_##mode,
+  INSTRUCTIONS(BENCH_LENGTH)
+};
+
+static const byte opcodes[] = {
+#define BENCH_OPCODE(name, mode, reg) OP_##name,
+  INSTRUCTIONS(BENCH_OPCODE)
+};
+
+// Sets up the data every load reads and the index registers
+static void loadData(Machine *machine) {
+  for(int i = 0; i < MEMORY_PAGE_SIZE; i++) {
+    writeByte(&machine->memory, i, i ^ 0x5A);
+    writeByte(&machine->memory, BENCH_DATA + i, i ^ 0xA5);
+  }
+  machine->cpu.PC = BENCH_START;
+  machine->cpu.X = 0x01;
+  machine->cpu.Y = 0x02;
+}
+
+// Writes one instruction, returns its length
+static byte writeInstruction(Memory *memory, word address, byte opcode) {
+  byte length = lengths[opcode];
+  word operand = length == LENGTH_ABS ? BENCH_DATA : BENCH_ZERO_PAGE;
+
+  writeByte(memory, address, opcode);
+  writeByte(memory, address + 1, operand & 0xFF);
+  if(length == LENGTH_ABS)
+    writeByte(memory, address + 2, operand >> 8);
+  return length;
+}
+
+// Fills the code area with as many copies of a sequence as fit
+static void loadSequence(Machine *machine, const byte *sequence, uint count) {
+  word address = BENCH_START;
+  uint i = 0;
+
+  loadData(machine);
+  while(address + lengths[sequence[i]] <= BENCH_START + BENCH_CODE_SIZE) {
+    address += writeInstruction(&machine->memory, address, sequence[i]);
+    i = (i + 1) % count;
+  }
+}
+
+#define BENCH_LOADER(name, mode, reg) \
+  static void load_##name(Machine *machine) { \
+    static const byte sequence[] = { OP_##name }; \
+    loadSequence(machine, sequence, 1); \
+  }
+
+INSTRUCTIONS(BENCH_LOADER)
+
+static void loadMixed(Machine *machine) {
+  loadSequence(machine, opcodes, sizeof(opcodes));
+}
+
+// Opcodes in a fixed pseudo-random order, so every pair turns up about as
+// often as any other
+static void loadShuffled(Machine *machine) {
+  static byte sequence[BENCH_CODE_SIZE / LENGTH_IM];
+  uint seed = 0x6502;
+  for(uint i = 0; i < sizeof(sequence); i++) {
+    seed = seed * 1103515245 + 12345;
+    sequence[i] = opcodes[(seed >> 16) % sizeof(opcodes)];
+  }
+  loadSequence(machine, sequence, sizeof(sequence));
+}
+
+#define BENCH_WORKLOAD(name, mode, reg) { #name, load_##name },
+
+const Workload workloads[] = {
+  INSTRUCTIONS(BENCH_WORKLOAD)
+  { "mixed", loadMixed },
+  { "shuffled", loadShuffled },
+};
+
+const uint workloadCount = sizeof(workloads) / sizeof(workloads[0]);
+
+const char * const engineNames[ENGINES] = {
+  [ENGINE_EXECUTE] = "execute",
+  [ENGINE_DECODED] = "decoded",
+  [ENGINE_JIT] = "jit",
+#ifdef BATCH_ENGINE
+  [ENGINE_BATCH] = "batch",
+#endif
+};
+
+/*
+ * Runner
+ */
+
+static Machine machine;
+static DecodeCache cache;
+static JIT jit;
+#ifdef BATCH_ENGINE
+static Batch batch;
+static Machine laneMachines[BATCH_LANES]; // Each batch lane has its own copy
+#endif
+
+// Steps through one pass, so every timed pass can be given a budget that
+// ends exactly on its last instruction
+static void measurePass(uint *instructions, uint *cycles) {
+  CPU start = machine.cpu;
+  uint budget = 0xFFFFFFFF;
+
+  *instructions = 0;
+  while(machine.cpu.PC < BENCH_START + BENCH_CODE_SIZE &&
+      lengths[readByte(&machine.memory, machine.cpu.PC)] != 0) {
+    step(&machine.cpu, &machine.memory, &budget);
+    (*instructions)++;
+  }
+  *cycles = 0xFFFFFFFF - budget;
+  machine.cpu = start;
+}
+
+static void runPasses(Engine engine, const CPU *start, uint passCycles) {
+  for(int i = 0; i < BENCH_PASSES; i++) {
+    uint cycles = passCycles;
+    machine.cpu = *start;
+    switch(engine) {
+      case ENGINE_EXECUTE:
+        execute(&machine.cpu, &machine.memory, &cycles);
+        break;
+      case ENGINE_DECODED:
+        executeDecoded(&cache, &machine.cpu, &machine.memory, &cycles);
+        break;
+#ifdef BATCH_ENGINE
+      case ENGINE_BATCH:
+        initBatch(&batch, BATCH_LANES);
+        for(uint lane = 0; lane < BATCH_LANES; lane++) {
+          setLane(&batch, lane, start, &laneMachines[lane].memory, passCycles);
+        }
+        executeBatch(&batch);
+        break;
+#endif
+      default:
+        executeJIT(&jit, &machine.cpu, &machine.memory, &cycles);
+        break;
+    }
+  }
+}
+
+// Adds one run to the result
+void runWorkload(const Workload *workload, Engine engine, BenchResult *result) {
+  uint passInstructions, passCycles;
+
+  resetMachine(&machine);
+  workload->load(&machine);
+  measurePass(&passInstructions, &passCycles);
+  CPU start = machine.cpu;
+
+  initDecodeCache(&cache);
+  if(engine == ENGINE_JIT)
+    initJIT(&jit);
+  // Every batch lane runs the whole pass
+  double lanes = 1;
+#ifdef BATCH_ENGINE
+  for(uint lane = 0; engine == ENGINE_BATCH && lane < BATCH_LANES; lane++) {
+    resetMachine(&laneMachines[lane]);
+    workload->load(&laneMachines[lane]);
+  }
+  if(engine == ENGINE_BATCH)
+    lanes = BATCH_LANES;
+#endif
+
+  runPasses(engine, &start, passCycles);
+
+  double passes = 0;
+  double begin = now();
+  double elapsed;
+  do {
+    runPasses(engine, &start, passCycles);
+    passes += BENCH_PASSES;
+    elapsed = now() - begin;
+  } while(elapsed < BENCH_SECONDS);
+
+  if(engine == ENGINE_JIT)
+    freeJIT(&jit);
+
+  result->workload = workload->name;
+  result->engine = engineNames[engine];
+  result->instructions += lanes * passes * passInstructions;
+  result->cycles += lanes * passes * passCycles;
+  result->seconds += elapsed;
+  result->samples[result->runs++] = lanes * passes * passInstructions / elapsed;
+}
+
+// One result per line, so results files can be read back line by line
+void writeResult(FILE *out, const BenchResult *result) {
+  fprintf(out, "{\"workload\": \"%s\", \"engine\": \"%s\", "
+    "\"instructions\": %.0f, \"cycles\": %.0f, \"seconds\": %.6f, "
+    "\"instructions_per_second\": %.0f, \"cycles_per_second\": %.0f, "
+    "\"ns_per_instruction\": %.3f, \"samples\": [",
+    result->workload, result->engine,
+    result->instructions, result->cycles, result->seconds,
+    result->instructions / result->seconds,
+    result->cycles / result->seconds,
+    result->seconds * 1e9 / result->instructions);
+  for(uint run = 0; run < result->runs; run++) {
+    fprintf(out, run > 0 ? ", %.0f" : "%.0f", result->samples[run]);
+  }
+  fprintf(out, "]}");
+}
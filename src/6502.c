@@ -1,32 +1,110 @@
 #include "6502.h"
+#include "debugger.h"
+#include "stats.h"
+#include "trace.h"
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
 
 /*
  * Basic Memory functions
  */
 
 void initMemory(Memory* memory) {
-  for(int i = 0; i < MEMORY_SIZE; i++) {
-    memory->data[i] = 0x00;
-  }
+  memset(memory->data, 0x00, sizeof(memory->data));
+  memset(memory->devices, 0, sizeof(memory->devices));
+  memset(memory->codePages, 0, sizeof(memory->codePages));
+  memset(memory->codeGeneration, 0, sizeof(memory->codeGeneration));
+  memset(memory->pageStamps, 0, sizeof(memory->pageStamps));
+  memory->writeStamp = 0;
+  memory->mapGeneration = 0;
+  detachDebugger(memory);
+#ifdef MEMORY_HEATMAP
+  memory->heatmap = NULL;
+#endif
+#ifdef EXECUTION_TRACE
+  memory->tracer = NULL;
+#endif
+  mapRAM(memory, 0x0000, MEMORY_SIZE);
 }
 
 byte readByte(Memory* memory, word address) {
-  return memory->data[address];
+  return busRead(memory, address);
 }
 
 void writeByte(Memory* memory, word address, byte value) {
-  memory->data[address] = value;
+  busWrite(memory, address, value);
 }
 
 word readWord(Memory* memory, word address) {
-  word low = memory->data[address];
-  word high = memory->data[address + 1];
+  word low = readByte(memory, address);
+  word high = readByte(memory, address + 1);
   return low | (high << 8);
 }
 
 void writeWord(Memory* memory, word address, word value) {
-  memory->data[address] = value & 0xFF;
-  memory->data[address + 1] = (value >> 8) & 0xFF;
+  writeByte(memory, address, value & 0xFF);
+  writeByte(memory, address + 1, (value >> 8) & 0xFF);
+}
+
+/*
+ * Memory map
+ */
+
+// Points the pages at new contents: drops any code translated from them
+static void remapPage(Memory *memory, uint page, const byte *read, byte *write, Device device) {
+  memory->readMap[page] = read;
+  memory->writeMap[page] = write;
+  memory->devices[page] = device;
+  invalidateCode(memory, page << 8);
+}
+
+void mapRAM(Memory *memory, word start, uint size) {
+  Device none = { 0 };
+  for(uint page = start >> 8; page <= (start + size - 1) >> 8 && page < MEMORY_PAGES; page++) {
+    remapPage(memory, page, &memory->data[page << 8], &memory->data[page << 8], none);
+  }
+  memory->mapGeneration++;
+}
+
+// Writes to ROM pages are ignored
+void mapROM(Memory *memory, word start, uint size, const byte *rom) {
+  Device none = { 0 };
+  for(uint page = start >> 8; page <= (start + size - 1) >> 8 && page < MEMORY_PAGES; page++) {
+    remapPage(memory, page, rom + (page << 8) - start, NULL, none);
+  }
+  memory->mapGeneration++;
+}
+
+void mapDevice(Memory *memory, word start, uint size, Device device) {
+  for(uint page = start >> 8; page <= (start + size - 1) >> 8 && page < MEMORY_PAGES; page++) {
+    remapPage(memory, page, NULL, NULL, device);
+  }
+  memory->mapGeneration++;
+}
+
+// Slow paths of busRead/busWrite. Unmapped device reads return 0x00.
+byte readDevice(const Memory *memory, word address) {
+  const Device *device = &memory->devices[address >> 8];
+  if(device->read == NULL)
+    return 0x00;
+  return device->read(device->context, address);
+}
+
+void writeDevice(Memory *memory, word address, byte value) {
+  const Device *device = &memory->devices[address >> 8];
+  if(device->write != NULL)
+    device->write(device->context, address, value);
+}
+
+// Called by translators for every page they read code from
+void markCode(Memory *memory, word address) {
+  memory->codePages[address >> 8] = 1;
+}
+
+void invalidateCode(Memory *memory, word address) {
+  memory->codePages[address >> 8] = 0;
+  memory->codeGeneration[address >> 8]++;
 }
 
 /*
@@ -34,68 +112,373 @@ void writeWord(Memory* memory, word address, word value) {
 */
 
 void reset(CPU *cpu, Memory *memory) {
+  resetCPU(cpu);
+  initMemory(memory);
+}
+
+// Resets the registers only, leaving memory as it is
+void resetCPU(CPU *cpu) {
   cpu->PC = 0xFFFC;
   cpu->SP = 0x01;
   cpu->A = cpu->X = cpu->Y = 0;
   cpu->PS = UNUSED_FLAG | IRQ_DISABLE_FLAG;
-  initMemory(memory);
-  initInstructions();
+  cpu->result = 0;
+  cpu->lazyFlags = 0;
 }
 
-byte CPUreadByte(const Memory *memory, const word address, uint *cycles) {
+// Bus accesses of the interpreter. Declared inline so the compiler keeps
+// them inlined into execute() and the addressing modes as the hooks grow.
+// watch is a constant in every caller: only the handlers of stepWatched()
+// pass 1, so the others compile without the debugger's test.
+static inline byte readData(const Memory *memory, word address, uint *cycles, byte watch) {
   (*cycles)--;
-  return memory->data[address];
+  HEAT(memory, reads, address);
+  TRACE_ACCESS(memory, address);
+  if(watch)
+    WATCH_ACCESS(memory, WATCH_READ, address);
+  return busRead(memory, address);
 }
 
-byte fetchByte(CPU *cpu, const Memory *memory, uint *cycles) {
-  byte data = CPUreadByte(memory, cpu->PC, cycles);
+byte CPUreadByte(const Memory *memory, const word address, uint *cycles) {
+  return readData(memory, address, cycles, 0);
+}
+
+static inline byte fetchNext(CPU *cpu, const Memory *memory, uint *cycles) {
+  (*cycles)--;
+  HEAT(memory, fetches, cpu->PC);
+  byte data = busRead(memory, cpu->PC);
   cpu->PC++;
   return data;
 }
 
+byte fetchByte(CPU *cpu, const Memory *memory, uint *cycles) {
+  return fetchNext(cpu, memory, cycles);
+}
+
 word fetchWord(CPU *cpu, const Memory *memory, uint *cycles) {
-  byte low = fetchByte(cpu, memory, cycles);
-  byte high = fetchByte(cpu, memory, cycles);
+  byte low = fetchNext(cpu, memory, cycles);
+  byte high = fetchNext(cpu, memory, cycles);
   word data = (high << 8) | low;
   return data;
 }
 
-instructionHandler instructions[256];
+// Dispatch table, fixed at compile time so machines on different threads can
+// share it
+#define INSTRUCTION_ENTRY(name, mode, reg) [OP_##name] = name,
+
+static const instructionHandler instructions[256] = {
+  INSTRUCTIONS(INSTRUCTION_ENTRY)
+  [OP_JSR] = JSR,
+  [OP_RTS] = RTS,
+};
+
+const byte opcodeStores[256] = {
+  [OP_JSR] = 1,
+};
+
+// Executes exactly one instruction, whatever the cycle budget
+void step(CPU *cpu, Memory *memory, uint *cycles) {
+  byte opcode = fetchNext(cpu, memory, cycles);
+  instructions[opcode](cpu, memory, cycles);
+  syncPS(cpu);
+}
+
+/*
+ * Table-driven cycle accounting
+ *
+ * With -DTABLE_CYCLES, execute() charges each opcode its base cost from
+ * cycleTable and keeps the running total in a 64-bit local instead of
+ * decrementing *cycles on every bus access. The handlers below read their
+ * operands straight from memory and only return the page crossing penalty
+ * of ABSX and ABSY.
+ */
+
+#ifdef TABLE_CYCLES
+
+#define CYCLE_ENTRY(name, mode, reg) [OP_##name] = CYCLES_##mode,
+
+static const byte cycleTable[256] = {
+  INSTRUCTIONS(CYCLE_ENTRY)
+};
+
+static inline byte operandByte(CPU *cpu, const Memory *memory) {
+  HEAT(memory, fetches, cpu->PC);
+  return busRead(memory, cpu->PC++);
+}
+
+static inline byte readOperand(const Memory *memory, word address) {
+  HEAT(memory, reads, address);
+  TRACE_ACCESS(memory, address);
+  return busRead(memory, address);
+}
+
+static inline word operandWord(CPU *cpu, const Memory *memory) {
+  word low = operandByte(cpu, memory);
+  word high = operandByte(cpu, memory);
+  return (high << 8) | low;
+}
+
+static inline byte loadIM(CPU *cpu, const Memory *memory, byte *penalty) {
+  return operandByte(cpu, memory);
+}
+
+static inline byte loadZP(CPU *cpu, const Memory *memory, byte *penalty) {
+  return readOperand(memory, operandByte(cpu, memory));
+}
+
+static inline byte loadZPX(CPU *cpu, const Memory *memory, byte *penalty) {
+  return readOperand(memory, (operandByte(cpu, memory) + cpu->X) % 256);
+}
 
-void initInstructions() {
-  instructions[OP_LDA_IM] = LDA_IM;
-  instructions[OP_LDA_ZP] = LDA_ZP;
-  instructions[OP_LDA_ZPX] = LDA_ZPX;
-  instructions[OP_LDA_ABS] = LDA_ABS;
-  instructions[OP_LDA_ABSX] = LDA_ABSX;
-  instructions[OP_LDA_ABSY] = LDA_ABSY;
+static inline byte loadZPY(CPU *cpu, const Memory *memory, byte *penalty) {
+  return readOperand(memory, (operandByte(cpu, memory) + cpu->Y) % 256);
+}
 
-  instructions[OP_LDX_IM] = LDX_IM;
-  instructions[OP_LDX_ZP] = LDX_ZP;
-  instructions[OP_LDX_ZPY] = LDX_ZPY;
-  instructions[OP_LDX_ABS] = LDX_ABS;
-  instructions[OP_LDX_ABSY] = LDX_ABSY;
+static inline byte loadABS(CPU *cpu, const Memory *memory, byte *penalty) {
+  return readOperand(memory, operandWord(cpu, memory));
+}
 
-  instructions[OP_LDY_IM] = LDY_IM;
-  instructions[OP_LDY_ZP] = LDY_ZP;
-  instructions[OP_LDY_ZPX] = LDY_ZPX;
-  instructions[OP_LDY_ABS] = LDY_ABS;
-  instructions[OP_LDY_ABSX] = LDY_ABSX;
+static inline byte loadABSX(CPU *cpu, const Memory *memory, byte *penalty) {
+  word address = operandWord(cpu, memory) + cpu->X;
+  *penalty = (address >> 8) != 0x00;
+  return readOperand(memory, address);
 }
 
-void execute(CPU *cpu, Memory *memory, uint *cycles) {
-  while(*cycles > 0) {
-    byte opcode = fetchByte(cpu, memory, cycles);
+static inline byte loadABSY(CPU *cpu, const Memory *memory, byte *penalty) {
+  word address = operandWord(cpu, memory) + cpu->Y;
+  *penalty = (address >> 8) != 0x00;
+  return readOperand(memory, address);
+}
+
+#define TABLE_HANDLER(name, mode, reg) \
+  static inline byte TABLE_##name(CPU *cpu, Memory *memory) { \
+    byte penalty = 0; \
+    cpu->reg = load##mode(cpu, memory, &penalty); \
+    setNZ(cpu, cpu->reg); \
+    return penalty; \
+  }
+
+INSTRUCTIONS(TABLE_HANDLER)
+
+#endif
+
+/*
+ * Interpreter core
+ *
+ * execute() uses direct-threaded dispatch: every handler ends with its own
+ * fetch and indirect jump, so the branch predictor sees one jump site per
+ * instruction instead of a single shared one. Handlers are called directly,
+ * which lets the compiler inline them.
+ *
+ * GCC and Clang use computed goto. Other compilers, or builds with
+ * -DSWITCH_DISPATCH, fall back to a plain switch.
+ *
+ * executeTable() is the original loop through the instructions table, kept
+ * as a reference for the tests.
+ *
+ * With a debugger attached, execute() hands the run to executeDebugged(), so
+ * the loops below never test for stops.
+ */
+
+#if defined(__GNUC__) && !defined(SWITCH_DISPATCH)
+#define COMPUTED_GOTO_DISPATCH
+#endif
+
+StopReason execute(CPU *cpu, Memory *memory, uint *cycles) {
+  uint64_t retired = 0;
+  return executeCounted(cpu, memory, cycles, &retired);
+}
+
+StopReason executeCounted(CPU *cpu, Memory *memory, uint *cycles, uint64_t *instructionCount) {
+  if(memory->debugger)
+    return executeDebugged(cpu, memory, cycles, instructionCount);
+
+  byte opcode;
+  uint64_t retired = 0;
+
+#ifdef TABLE_CYCLES
+  int64_t budget = cyclesLeft(*cycles) ? (int64_t)*cycles : (int)*cycles;
+  int64_t spent = 0;
+
+  // Handlers outside INSTRUCTIONS still count through a pointer. The opcode
+  // fetch isn't in cycleTable for them, hence the extra cycle.
+  #define CYCLES_LEFT() (spent < budget)
+  #define FETCH() (opcode = operandByte(cpu, memory), spent += cycleTable[opcode], opcode)
+  #define RUN(name) (spent += TABLE_##name(cpu, memory))
+  #define RUN_UNKNOWN() do { \
+    uint left = 0; \
+    instructions[opcode](cpu, memory, &left); \
+    spent += 1 + (uint)(0 - left); \
+  } while(0)
+  #define FINISH() (*cycles = (uint)(budget - spent), syncPS(cpu))
+  #define CYCLES_SPENT() ((uint)spent)
+#else
+  #define CYCLES_LEFT() cyclesLeft(*cycles)
+  #define FETCH() fetchNext(cpu, memory, cycles)
+  #define RUN(name) name(cpu, memory, cycles)
+  #define RUN_UNKNOWN() instructions[opcode](cpu, memory, cycles)
+  #define FINISH() syncPS(cpu)
+  #define CYCLES_SPENT() (0u - *cycles)
+#endif
+
+#ifdef OPCODE_STATS
+  uint64_t statsTicks = 0;
+  uint statsCycles = 0;
+  int statsPrevious = -1; // Opcode of the last instruction, for the pairs
+
+  #define STATS_BEGIN() (statsTicks = readTicks(), statsCycles = CYCLES_SPENT())
+  #define STATS_END() do { \
+    OpcodeCounter *counter = &opcodeStats[opcode]; \
+    counter->count++; \
+    counter->cycles += CYCLES_SPENT() - statsCycles; \
+    counter->ticks += readTicks() - statsTicks; \
+    if(statsPrevious >= 0) \
+      opcodePairs[statsPrevious][opcode]++; \
+    statsPrevious = opcode; \
+  } while(0)
+#else
+  #define STATS_BEGIN()
+  #define STATS_END()
+#endif
+
+#ifdef EXECUTION_TRACE
+  Tracer *tracer = memory->tracer;
+  word tracePC = 0;
+  if(tracer)
+    traceSync(tracer, cpu);
+
+  #define TRACE_BEGIN() (tracePC = cpu->PC)
+  #define TRACE_END() do { \
+    if(tracer) \
+      traceInstruction(tracer, cpu, opcode, tracePC); \
+  } while(0)
+#else
+  #define TRACE_BEGIN()
+  #define TRACE_END()
+#endif
+
+  #define BEGIN_INSTRUCTION() do { retired++; STATS_BEGIN(); TRACE_BEGIN(); } while(0)
+  #define END_INSTRUCTION() do { STATS_END(); TRACE_END(); } while(0)
+
+#ifdef COMPUTED_GOTO_DISPATCH
+  #define LABEL_ENTRY(name, mode, reg) [OP_##name] = &&L_##name,
+  #define LABEL_HANDLER(name, mode, reg) L_##name: RUN(name); END_INSTRUCTION(); DISPATCH();
+  #define DISPATCH() do { \
+    if(!CYCLES_LEFT()) goto L_DONE; \
+    BEGIN_INSTRUCTION(); \
+    opcode = FETCH(); \
+    goto *labels[opcode]; \
+  } while(0)
+
+  static void * const labels[256] = {
+    [0 ... 255] = &&L_UNKNOWN,
+    INSTRUCTIONS(LABEL_ENTRY)
+  };
+
+  DISPATCH();
+  INSTRUCTIONS(LABEL_HANDLER)
+L_UNKNOWN:
+  RUN_UNKNOWN();
+  END_INSTRUCTION();
+  DISPATCH();
+L_DONE:
+  FINISH();
+
+  #undef DISPATCH
+  #undef LABEL_HANDLER
+  #undef LABEL_ENTRY
+#else
+  #define CASE_HANDLER(name, mode, reg) case OP_##name: RUN(name); break;
+
+  while(CYCLES_LEFT()) {
+    BEGIN_INSTRUCTION();
+    opcode = FETCH();
+    switch(opcode) {
+      INSTRUCTIONS(CASE_HANDLER)
+      default:
+        RUN_UNKNOWN();
+    }
+    END_INSTRUCTION();
+  }
+  FINISH();
+
+  #undef CASE_HANDLER
+#endif
+
+  #undef END_INSTRUCTION
+  #undef BEGIN_INSTRUCTION
+  #undef TRACE_END
+  #undef TRACE_BEGIN
+  #undef STATS_END
+  #undef STATS_BEGIN
+  #undef CYCLES_SPENT
+  #undef FINISH
+  #undef RUN_UNKNOWN
+  #undef RUN
+  #undef FETCH
+  #undef CYCLES_LEFT
+
+  *instructionCount += retired;
+  return STOP_BUDGET;
+}
+
+void executeTable(CPU *cpu, Memory *memory, uint *cycles) {
+  while(cyclesLeft(*cycles)) {
+    byte opcode = fetchNext(cpu, memory, cycles);
     instructionHandler handler = instructions[opcode];
     handler(cpu, memory, cycles);
   }
+  syncPS(cpu);
+}
+
+/*
+ * Machine
+ */
+
+void resetMachine(Machine *machine) {
+  reset(&machine->cpu, &machine->memory);
+}
+
+StopReason runMachine(Machine *machine, uint *cycles) {
+  return execute(&machine->cpu, &machine->memory, cycles);
+}
+
+RunResult runUntil(Machine *machine, uint64_t *clock, uint64_t deadline) {
+  RunResult result = { 0, 0, STOP_BUDGET };
+
+  while(*clock < deadline && result.stop == STOP_BUDGET) {
+    // Slices fit an int, so the budget left converts back exactly
+    uint64_t slice = deadline - *clock;
+    if(slice > INT_MAX)
+      slice = INT_MAX;
+
+    uint budget = slice;
+    result.stop = executeCounted(&machine->cpu, &machine->memory, &budget, &result.instructions);
+    uint64_t spent = (int64_t)slice - (int)budget;
+    *clock += spent;
+    result.cycles += spent;
+  }
+  return result;
 }
 
 /*
  * Opcodes implementation
  */
 
+// Brings ZERO and NEGATIVE up to date with the last recorded result. Every
+// run function calls it before returning, so PS can be read directly
+// outside of them.
+void syncPS(CPU *cpu) {
+  if(cpu->lazyFlags) {
+    cpu->PS &= ~(ZERO_FLAG | NEGATIVE_FLAG);
+    cpu->PS |= (cpu->result == 0) ? ZERO_FLAG : 0;
+    cpu->PS |= cpu->result & NEGATIVE_FLAG;
+    cpu->lazyFlags = 0;
+  }
+}
+
 void setPS(CPU *cpu, byte *target, byte flags) {
+  syncPS(cpu);
   if(flags & ZERO_FLAG) {
     cpu->PS = (*target == 0) ? (cpu->PS | ZERO_FLAG) : (cpu->PS & ~ZERO_FLAG);
   }
@@ -106,6 +489,10 @@ void setPS(CPU *cpu, byte *target, byte flags) {
 
 /*
  * Addressing modes
+ *
+ * Each one returns the byte its mode loads, charging the cycles of the
+ * operand fetches and of the read. They are inlined into the handlers, which
+ * store the byte straight into their register.
  */
 
 /*
@@ -114,11 +501,8 @@ void setPS(CPU *cpu, byte *target, byte flags) {
  * Bytes: 2
  * Cycles: 2
  */
-void ADDR_IM(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
-  byte data = fetchByte(cpu, memory, cycles);
-  *target = data;
-  
-  setPS(cpu, target, ZERO_FLAG | NEGATIVE_FLAG);
+static inline byte ADDR_IM(CPU *cpu, const Memory *memory, uint *cycles, byte watch) {
+  return fetchNext(cpu, memory, cycles);
 }
 
 /*
@@ -127,12 +511,9 @@ void ADDR_IM(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
  * Bytes: 2
  * Cycles: 3
  */
-void ADDR_ZP(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
-  byte address = fetchByte(cpu, memory, cycles);
-  byte data = CPUreadByte(memory, address, cycles);
-  *target = data;
-
-  setPS(cpu, target, ZERO_FLAG | NEGATIVE_FLAG);
+static inline byte ADDR_ZP(CPU *cpu, const Memory *memory, uint *cycles, byte watch) {
+  byte address = fetchNext(cpu, memory, cycles);
+  return readData(memory, address, cycles, watch);
 }
 
 /*
@@ -141,14 +522,11 @@ void ADDR_ZP(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
  * Bytes: 2
  * Cycles: 4
  */
-void ADDR_ZPX(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
-  byte address = fetchByte(cpu, memory, cycles);
+static inline byte ADDR_ZPX(CPU *cpu, const Memory *memory, uint *cycles, byte watch) {
+  byte address = fetchNext(cpu, memory, cycles);
   address = (address + cpu->X) % 256;
   (*cycles)--;
-  byte data = CPUreadByte(memory, address, cycles);
-  *target = data;
-
-  setPS(cpu, target, ZERO_FLAG | NEGATIVE_FLAG);
+  return readData(memory, address, cycles, watch);
 }
 
 /*
@@ -157,14 +535,11 @@ void ADDR_ZPX(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
  * Bytes: 2
  * Cycles: 4
  */
-void ADDR_ZPY(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
-  byte address = fetchByte(cpu, memory, cycles);
+static inline byte ADDR_ZPY(CPU *cpu, const Memory *memory, uint *cycles, byte watch) {
+  byte address = fetchNext(cpu, memory, cycles);
   address = (address + cpu->Y) % 256;
   (*cycles)--;
-  byte data = CPUreadByte(memory, address, cycles);
-  *target = data;
-
-  setPS(cpu, target, ZERO_FLAG | NEGATIVE_FLAG);
+  return readData(memory, address, cycles, watch);
 }
 
 /*
@@ -173,12 +548,9 @@ void ADDR_ZPY(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
  * Bytes: 3
  * Cycles: 4
  */
-void ADDR_ABS(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
+static inline byte ADDR_ABS(CPU *cpu, const Memory *memory, uint *cycles, byte watch) {
   word address = fetchWord(cpu, memory, cycles);
-  byte data = CPUreadByte(memory, address, cycles);
-  *target = data;
-
-  setPS(cpu, target, ZERO_FLAG | NEGATIVE_FLAG);
+  return readData(memory, address, cycles, watch);
 }
 
 /*
@@ -187,16 +559,13 @@ void ADDR_ABS(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
  * Bytes: 3
  * Cycles: 4-5
  */
-void ADDR_ABSX(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
+static inline byte ADDR_ABSX(CPU *cpu, const Memory *memory, uint *cycles, byte watch) {
   word address = fetchWord(cpu, memory, cycles);
   address += cpu->X;
   byte high = (address >> 8) & 0xFF;
   if (high != 0x00)
     (*cycles)--;
-  byte data = CPUreadByte(memory, address, cycles);
-  *target = data;
-
-  setPS(cpu, target, ZERO_FLAG | NEGATIVE_FLAG);
+  return readData(memory, address, cycles, watch);
 }
 
 /*
@@ -205,138 +574,120 @@ void ADDR_ABSX(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
  * Bytes: 3
  * Cycles: 4-5
  */
-void ADDR_ABSY(CPU *cpu, Memory *memory, byte *target, uint *cycles) {
+static inline byte ADDR_ABSY(CPU *cpu, const Memory *memory, uint *cycles, byte watch) {
   word address = fetchWord(cpu, memory, cycles);
   address += cpu->Y;
   byte high = (address >> 8) & 0xFF;
   if (high != 0x00)
     (*cycles)--;
-  byte data = CPUreadByte(memory, address, cycles);
-  *target = data;
-
-  setPS(cpu, target, ZERO_FLAG | NEGATIVE_FLAG);
+  return readData(memory, address, cycles, watch);
 }
 
 /*
- * LDA instruction
+ * LDA, LDX and LDY instructions
+ *
+ * One handler per INSTRUCTIONS entry: LDA_ZPX loads A through ADDR_ZPX, and
+ * so on. The opcodes are the OP_* constants in 6502.h. WATCHED_LDA_ZPX and
+ * the rest are the same handlers with the watch hooks, for stepWatched().
  */
 
-// LDA immediate addressing mode
-// Assembly: LDA #$nn
-// Opcode: 0xA9
-void LDA_IM(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_IM(cpu, memory, &cpu->A, cycles);
-}
+#define LOAD_HANDLER(name, mode, reg) \
+  void name(CPU *cpu, Memory *memory, uint *cycles) { \
+    cpu->reg = ADDR_##mode(cpu, memory, cycles, 0); \
+    setNZ(cpu, cpu->reg); \
+  } \
+  static void WATCHED_##name(CPU *cpu, Memory *memory, uint *cycles) { \
+    cpu->reg = ADDR_##mode(cpu, memory, cycles, 1); \
+    setNZ(cpu, cpu->reg); \
+  }
 
-// LDA zero page addressing mode
-// Assembly: LDA $nn
-// Opcode: 0xA5
-void LDA_ZP(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ZP(cpu, memory, &cpu->A, cycles);
-}
+INSTRUCTIONS(LOAD_HANDLER)
 
-// LDA zero page X-indexed addressing mode
-// Assembly: LDA $nn,X
-// Opcode: 0xB5
-void LDA_ZPX(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ZPX(cpu, memory, &cpu->A, cycles);
-}
-
-// LDA absolute addressing mode
-// Assembly: LDA $nnnn
-// Opcode: 0xAD
-void LDA_ABS(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ABS(cpu, memory, &cpu->A, cycles);
-}
+/*
+ * Stack operations
+ */
 
-// LDA absolute X-indexed addressing mode
-// Assembly: LDA $nnnn,X
-// Opcode: 0xBD
-void LDA_ABSX(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ABSX(cpu, memory, &cpu->A, cycles);
+static inline void pushByte(CPU *cpu, Memory *memory, byte value, uint *cycles, byte watch) {
+  (*cycles)--;
+  TRACE_ACCESS(memory, STACK_BASE | cpu->SP);
+  if(watch)
+    WATCH_ACCESS(memory, WATCH_WRITE, STACK_BASE | cpu->SP);
+  busWrite(memory, STACK_BASE | cpu->SP, value);
+  cpu->SP--;
 }
 
-// LDA absolute Y-indexed addressing mode
-// Assembly: LDA $nnnn,Y
-// Opcode: 0xB9
-void LDA_ABSY(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ABSY(cpu, memory, &cpu->A, cycles);
+static inline byte pullByte(CPU *cpu, Memory *memory, uint *cycles, byte watch) {
+  cpu->SP++;
+  return readData(memory, STACK_BASE | cpu->SP, cycles, watch);
 }
 
 /*
- * LDX instruction
+ * JSR instruction
  */
 
-// LDX immediate addressing mode
-// Assembly: LDX #$nn
-// Opcode: 0xA2
-void LDX_IM(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_IM(cpu, memory, &cpu->X, cycles);
-}
-
-// LDX zero page addressing mode
-// Assembly: LDX $nn
-// Opcode: 0xA6
-void LDX_ZP(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ZP(cpu, memory, &cpu->X, cycles);
-}
-
-// LDX zero page Y-indexed addressing mode
-// Assembly: LDX $nn,Y
-// Opcode: 0xB6
-void LDX_ZPY(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ZPY(cpu, memory, &cpu->X, cycles);
+// JSR absolute addressing mode
+// Assembly: JSR $nnnn
+// Opcode: 0x20
+// Cycles: 6
+// Pushes the address of its own last byte, high byte first
+static inline void jumpToSubroutine(CPU *cpu, Memory *memory, uint *cycles, byte watch) {
+  word address = fetchWord(cpu, memory, cycles);
+  word returnAddress = cpu->PC - 1;
+  (*cycles)--;
+  pushByte(cpu, memory, returnAddress >> 8, cycles, watch);
+  pushByte(cpu, memory, returnAddress & 0xFF, cycles, watch);
+  cpu->PC = address;
 }
 
-// LDX absolute addressing mode
-// Assembly: LDX $nnnn
-// Opcode: 0xAE
-void LDX_ABS(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ABS(cpu, memory, &cpu->X, cycles);
+void JSR(CPU *cpu, Memory *memory, uint *cycles) {
+  jumpToSubroutine(cpu, memory, cycles, 0);
 }
 
-// LDX absolute Y-indexed addressing mode
-// Assembly: LDX $nnnn,Y
-// Opcode: 0xBE
-void LDX_ABSY(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ABSY(cpu, memory, &cpu->X, cycles);
+static void WATCHED_JSR(CPU *cpu, Memory *memory, uint *cycles) {
+  jumpToSubroutine(cpu, memory, cycles, 1);
 }
 
 /*
- * LDY instruction
+ * RTS instruction
  */
 
-// LDY immediate addressing mode
-// Assembly: LDY #$nn
-// Opcode: 0xA0
-void LDY_IM(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_IM(cpu, memory, &cpu->Y, cycles);
+// RTS implied addressing mode
+// Assembly: RTS
+// Opcode: 0x60
+// Cycles: 6
+static inline void returnFromSubroutine(CPU *cpu, Memory *memory, uint *cycles, byte watch) {
+  (*cycles) -= 2;
+  word low = pullByte(cpu, memory, cycles, watch);
+  word high = pullByte(cpu, memory, cycles, watch);
+  cpu->PC = ((high << 8) | low) + 1;
+  (*cycles)--;
 }
 
-// LDY zero page addressing mode
-// Assembly: LDY $nn
-// Opcode: 0xA4
-void LDY_ZP(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ZP(cpu, memory, &cpu->Y, cycles);
+void RTS(CPU *cpu, Memory *memory, uint *cycles) {
+  returnFromSubroutine(cpu, memory, cycles, 0);
 }
 
-// LDY zero page X-indexed addressing mode
-// Assembly: LDY $nn,X
-// Opcode: 0xB4
-void LDY_ZPX(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ZPX(cpu, memory, &cpu->Y, cycles);
+static void WATCHED_RTS(CPU *cpu, Memory *memory, uint *cycles) {
+  returnFromSubroutine(cpu, memory, cycles, 1);
 }
 
-// LDY absolute addressing mode
-// Assembly: LDY $nnnn
-// Opcode: 0xAC
-void LDY_ABS(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ABS(cpu, memory, &cpu->Y, cycles);
-}
+/*
+ * Watched instructions
+ *
+ * The dispatch table of executeDebugged(), the only loop that reports data
+ * accesses to the debugger.
+ */
+
+#define WATCHED_ENTRY(name, mode, reg) [OP_##name] = WATCHED_##name,
+
+static const instructionHandler watchedInstructions[256] = {
+  INSTRUCTIONS(WATCHED_ENTRY)
+  [OP_JSR] = WATCHED_JSR,
+  [OP_RTS] = WATCHED_RTS,
+};
 
-// LDY absolute X-indexed addressing mode
-// Assembly: LDY $nnnn,X
-// Opcode: 0xBC
-void LDY_ABSX(CPU *cpu, Memory *memory, uint *cycles) {
-  ADDR_ABSX(cpu, memory, &cpu->Y, cycles);
+void stepWatched(CPU *cpu, Memory *memory, uint *cycles) {
+  byte opcode = fetchNext(cpu, memory, cycles);
+  watchedInstructions[opcode](cpu, memory, cycles);
+  syncPS(cpu);
 }
@@ -1,6 +1,8 @@
 #ifndef C6502_H
 #define C6502_H
 
+#include <stdint.h>
+
 /*
  * TYPES
  * Data types used in the 6502
@@ -14,14 +16,82 @@ typedef unsigned int uint;
 /*
  * MEMORY
  *
- * Holds an array of bytes that represents the 64KB of memory the 6502 has.
+ * Holds an array of bytes that represents the 64KB of memory the 6502 has,
+ * and the page table that maps it, ROM images and devices onto the bus.
  * Also includes functions for basic memory manipulation operations.
  */
 
 #define MEMORY_SIZE 1024 * 64 // 64KB of memory
+#define MEMORY_PAGE_SIZE 256
+#define MEMORY_PAGES (MEMORY_SIZE / MEMORY_PAGE_SIZE)
+
+// Memory is reached through a page table. Each 256-byte page either points
+// straight at host memory (RAM in data, or a ROM image) or, when its map
+// entry is NULL, at the read/write callbacks of a device. Every page maps
+// its own slice of data until something else is mapped over it.
+typedef byte (*deviceRead)(void *context, word address);
+typedef void (*deviceWrite)(void *context, word address, byte value);
 
+typedef struct {
+  deviceRead read;
+  deviceWrite write;
+  void *context;
+} Device;
+
+// Accesses per address, saturating at 0xFFFFFFFF. With -DMEMORY_HEATMAP the
+// interpreter counts into the heat map attached to a Memory, see heatmap.h.
+typedef struct {
+  uint reads[MEMORY_SIZE];
+  uint writes[MEMORY_SIZE];
+  uint fetches[MEMORY_SIZE]; // Opcode and operand bytes read from PC
+} HeatMap;
+
+#ifdef MEMORY_HEATMAP
+#define HEAT(memory, kind, address) do { \
+  if((memory)->heatmap) { \
+    uint *counter = &(memory)->heatmap->kind[address]; \
+    *counter += *counter != 0xFFFFFFFF; \
+  } \
+} while(0)
+#else
+#define HEAT(memory, kind, address)
+#endif
+
+// Why execute() returned, see debugger.h for the stops
+typedef enum {
+  STOP_BUDGET, // The cycle budget ran out
+  STOP_BREAKPOINT, // Before an instruction with a breakpoint
+  STOP_READ, // After an instruction that read a watched address
+  STOP_WRITE // After an instruction that wrote a watched address
+} StopReason;
+
+// Pages that hold translated code are marked in codePages. Writing to a marked
+// page bumps its codeGeneration, so translators can tell their copy is stale.
+// Writes must go through writeByte/writeWord for this to work, and since
+// initMemory() starts the generations over, translators are reset with it.
+// mapGeneration is bumped on every change to the page table.
+// writeStamp counts the snapshots taken, and every RAM write stamps its page
+// with it, so a snapshot can tell which pages were written after it.
+// watchPages holds the debugger's flags for each page, all zero when no
+// debugger is attached.
 typedef struct {
   byte data[MEMORY_SIZE];
+  const byte *readMap[MEMORY_PAGES];
+  byte *writeMap[MEMORY_PAGES];
+  Device devices[MEMORY_PAGES];
+  uint mapGeneration;
+  byte codePages[MEMORY_PAGES];
+  uint codeGeneration[MEMORY_PAGES];
+  uint64_t writeStamp;
+  uint64_t pageStamps[MEMORY_PAGES];
+  const byte *watchPages;
+  struct Debugger *debugger; // NULL when not debugging, initMemory() detaches it
+#ifdef MEMORY_HEATMAP
+  HeatMap *heatmap; // NULL when not counting, initMemory() detaches it
+#endif
+#ifdef EXECUTION_TRACE
+  struct Tracer *tracer; // NULL when not tracing, see trace.h
+#endif
 } Memory;
 
 void initMemory(Memory *memory);
@@ -29,6 +99,42 @@ byte readByte(Memory *memory, word address);
 void writeByte(Memory *memory, word address, byte value);
 word readWord(Memory *memory, word address);
 void writeWord(Memory *memory, word address, word value);
+void markCode(Memory *memory, word address);
+void invalidateCode(Memory *memory, word address);
+
+// Mappings cover whole pages: start is page aligned and size a multiple of
+// MEMORY_PAGE_SIZE
+void mapRAM(Memory *memory, word start, uint size);
+void mapROM(Memory *memory, word start, uint size, const byte *rom);
+void mapDevice(Memory *memory, word start, uint size, Device device);
+byte readDevice(const Memory *memory, word address);
+void writeDevice(Memory *memory, word address, byte value);
+
+// Whether a page reads straight from its own slice of data
+static inline byte isRAMPage(const Memory *memory, byte page) {
+  return memory->readMap[page] == &memory->data[page << 8];
+}
+
+// Bus access, a single load or store for pages backed by host memory
+static inline byte busRead(const Memory *memory, word address) {
+  const byte *page = memory->readMap[address >> 8];
+  if(page)
+    return page[address & 0xFF];
+  return readDevice(memory, address);
+}
+
+static inline void busWrite(Memory *memory, word address, byte value) {
+  byte *page = memory->writeMap[address >> 8];
+  if(page) {
+    page[address & 0xFF] = value;
+    memory->pageStamps[address >> 8] = memory->writeStamp;
+  } else {
+    writeDevice(memory, address, value);
+  }
+  HEAT(memory, writes, address);
+  if(memory->codePages[address >> 8])
+    invalidateCode(memory, address);
+}
 
 
 /*
@@ -58,16 +164,77 @@ typedef struct {
 
   byte PS; // Processor status flags
 
+  // ZERO and NEGATIVE are evaluated lazily: loads only record their result
+  // here, and syncPS() folds it into PS when something needs to read it.
+  byte result; // Last result byte
+  byte lazyFlags; // Whether ZERO and NEGATIVE of PS are out of date
+
 } CPU;
 
 typedef void (*instructionHandler)(CPU *cpu, Memory *memory, uint *cycles);
 
-void initInstructions();
 void reset(CPU *cpu, Memory *memory);
+void resetCPU(CPU *cpu);
 byte CPUreadByte(const Memory *memory, const word address, uint *cycles);
 byte fetchByte(CPU *cpu, const Memory *memory, uint *cycles);
 word fetchWord(CPU *cpu, const Memory *memory, uint *cycles);
-void execute(CPU *cpu, Memory *memory, uint *cycles);
+void step(CPU *cpu, Memory *memory, uint *cycles);
+
+// Whether a budget has cycles left. The top CYCLES_OVERRUN values are read
+// as the overrun of a previous run and run nothing, every other nonzero
+// budget runs, including those above INT_MAX.
+#define CYCLES_OVERRUN 256
+
+static inline byte cyclesLeft(uint cycles) {
+  return cycles - 1 < (uint)-CYCLES_OVERRUN - 1;
+}
+
+// Runs until the budget in *cycles is used up, or a debugger stops it.
+// Budgets are unsigned. When the last instruction overruns, *cycles is left
+// holding minus the overrun, which wraps to the top of the range, see
+// cyclesLeft().
+StopReason execute(CPU *cpu, Memory *memory, uint *cycles);
+// Same, adding the instructions it ran to *instructionCount
+StopReason executeCounted(CPU *cpu, Memory *memory, uint *cycles, uint64_t *instructionCount);
+void executeTable(CPU *cpu, Memory *memory, uint *cycles);
+void setPS(CPU *cpu, byte *target, byte flags);
+void syncPS(CPU *cpu);
+
+// Records a result for the ZERO and NEGATIVE flags, see syncPS()
+static inline void setNZ(CPU *cpu, byte value) {
+  cpu->result = value;
+  cpu->lazyFlags = 1;
+}
+
+/*
+ * MACHINE
+ *
+ * A complete emulator: a CPU and the memory it runs on. The dispatch table
+ * is constant, so machines share no mutable state and each thread can run
+ * its own.
+ */
+
+typedef struct {
+  CPU cpu;
+  Memory memory;
+} Machine;
+
+void resetMachine(Machine *machine);
+StopReason runMachine(Machine *machine, uint *cycles);
+
+// What a runUntil() call retired
+typedef struct {
+  uint64_t cycles;
+  uint64_t instructions;
+  StopReason stop;
+} RunResult;
+
+// Runs until *clock, a 64-bit cycle count kept by the caller, reaches the
+// deadline or a debugger stops the machine. The last instruction may take
+// *clock past the deadline: the next call starts from there, so the overshoot
+// is paid out of the next slice instead of being lost. A deadline at or
+// before *clock runs nothing.
+RunResult runUntil(Machine *machine, uint64_t *clock, uint64_t deadline);
 
 // Opcodes
 // LDA - Load accumulator with memory
@@ -94,23 +261,77 @@ void execute(CPU *cpu, Memory *memory, uint *cycles);
 #define OP_LDY_ABS  0xAC // Absolute addressing mode
 #define OP_LDY_ABSX 0xBC // Absolute X-indexed addressing mode
 
-void LDA_IM(CPU *cpu, Memory *memory, uint *cycles);
-void LDA_ZP(CPU *cpu, Memory *memory, uint *cycles);
-void LDA_ZPX(CPU *cpu, Memory *memory, uint *cycles);
-void LDA_ABS(CPU *cpu, Memory *memory, uint *cycles);
-void LDA_ABSX(CPU *cpu, Memory *memory, uint *cycles);
-void LDA_ABSY(CPU *cpu, Memory *memory, uint *cycles);
-
-void LDX_IM(CPU *cpu, Memory *memory, uint *cycles);
-void LDX_ZP(CPU *cpu, Memory *memory, uint *cycles);
-void LDX_ZPY(CPU *cpu, Memory *memory, uint *cycles);
-void LDX_ABS(CPU *cpu, Memory *memory, uint *cycles);
-void LDX_ABSY(CPU *cpu, Memory *memory, uint *cycles);
-
-void LDY_IM(CPU *cpu, Memory *memory, uint *cycles);
-void LDY_ZP(CPU *cpu, Memory *memory, uint *cycles);
-void LDY_ZPX(CPU *cpu, Memory *memory, uint *cycles);
-void LDY_ABS(CPU *cpu, Memory *memory, uint *cycles);
-void LDY_ABSX(CPU *cpu, Memory *memory, uint *cycles);
+// JSR - Jump to subroutine, saving the return address
+#define OP_JSR      0x20 // Absolute addressing mode
+
+// RTS - Return from subroutine
+#define OP_RTS      0x60 // Implied addressing mode
+
+// The stack lives in page 1, at STACK_BASE + SP, and grows down
+#define STACK_BASE 0x0100
+
+// Opcodes that store to memory
+extern const byte opcodeStores[256];
+
+// Addressing modes, named after the ADDR_* helpers
+typedef enum {
+  MODE_IM,
+  MODE_ZP,
+  MODE_ZPX,
+  MODE_ZPY,
+  MODE_ABS,
+  MODE_ABSX,
+  MODE_ABSY
+} AddressingMode;
+
+// Instruction bytes and base cycles of each addressing mode. ABSX and ABSY
+// take one more cycle when the indexed address is outside the zero page.
+#define LENGTH_IM   2
+#define LENGTH_ZP   2
+#define LENGTH_ZPX  2
+#define LENGTH_ZPY  2
+#define LENGTH_ABS  3
+#define LENGTH_ABSX 3
+#define LENGTH_ABSY 3
+
+#define CYCLES_IM   2
+#define CYCLES_ZP   3
+#define CYCLES_ZPX  4
+#define CYCLES_ZPY  4
+#define CYCLES_ABS  4
+#define CYCLES_ABSX 4
+#define CYCLES_ABSY 4
+
+// Every implemented load instruction, used to generate the handlers, dispatch
+// code and tables. INSTRUCTION(name, mode, register) expands once per handler;
+// the opcode is OP_##name, the addressing mode is one of the ADDR_* helpers,
+// with its length and base cycles in LENGTH_##mode and CYCLES_##mode, and
+// register is the CPU field it loads. Other instructions (JSR, RTS) are only
+// in the dispatch table, and the translators hand them to step().
+#define INSTRUCTIONS(INSTRUCTION) \
+  INSTRUCTION(LDA_IM,   IM,   A) \
+  INSTRUCTION(LDA_ZP,   ZP,   A) \
+  INSTRUCTION(LDA_ZPX,  ZPX,  A) \
+  INSTRUCTION(LDA_ABS,  ABS,  A) \
+  INSTRUCTION(LDA_ABSX, ABSX, A) \
+  INSTRUCTION(LDA_ABSY, ABSY, A) \
+  INSTRUCTION(LDX_IM,   IM,   X) \
+  INSTRUCTION(LDX_ZP,   ZP,   X) \
+  INSTRUCTION(LDX_ZPY,  ZPY,  X) \
+  INSTRUCTION(LDX_ABS,  ABS,  X) \
+  INSTRUCTION(LDX_ABSY, ABSY, X) \
+  INSTRUCTION(LDY_IM,   IM,   Y) \
+  INSTRUCTION(LDY_ZP,   ZP,   Y) \
+  INSTRUCTION(LDY_ZPX,  ZPX,  Y) \
+  INSTRUCTION(LDY_ABS,  ABS,  Y) \
+  INSTRUCTION(LDY_ABSX, ABSX, Y)
+
+// One handler per entry: void LDA_IM(CPU *cpu, Memory *memory, uint *cycles)
+// and so on, generated in 6502.c
+#define DECLARE_HANDLER(name, mode, reg) void name(CPU *cpu, Memory *memory, uint *cycles);
+INSTRUCTIONS(DECLARE_HANDLER)
+
+void JSR(CPU *cpu, Memory *memory, uint *cycles);
+void RTS(CPU *cpu, Memory *memory, uint *cycles);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "batch.h"
+#include <stddef.h>
+
+#ifdef BATCH_ENGINE
+
+/*
+ * Lanes
+ */
+
+void initBatch(Batch *batch, uint lanes) {
+  batch->lanes = lanes < BATCH_LANES ? lanes : BATCH_LANES;
+  for(uint lane = 0; lane < BATCH_LANES; lane++) {
+    batch->cycles[lane] = 0;
+    batch->memory[lane] = 0;
+  }
+}
+
+void setLane(Batch *batch, uint lane, const CPU *cpu, Memory *memory, uint cycles) {
+  CPU synced = *cpu;
+  syncPS(&synced);
+
+  batch->PC[lane] = synced.PC;
+  batch->SP[lane] = synced.SP;
+  batch->A[lane] = synced.A;
+  batch->X[lane] = synced.X;
+  batch->Y[lane] = synced.Y;
+  batch->PS[lane] = synced.PS;
+  batch->cycles[lane] = cycles;
+  batch->memory[lane] = memory;
+}
+
+void getLane(const Batch *batch, uint lane, CPU *cpu) {
+  cpu->PC = batch->PC[lane];
+  cpu->SP = batch->SP[lane];
+  cpu->A = batch->A[lane];
+  cpu->X = batch->X[lane];
+  cpu->Y = batch->Y[lane];
+  cpu->PS = batch->PS[lane];
+  cpu->result = 0;
+  cpu->lazyFlags = 0;
+}
+
+/*
+ * Kernels
+ */
+
+typedef struct {
+  byte length; // 0 when there is no batch kernel for the opcode
+  byte cycles;
+  byte mode;
+  byte target; // 0 = A, 1 = X, 2 = Y
+} batchInstruction;
+
+#define TARGET_A 0
+#define TARGET_X 1
+#define TARGET_Y 2
+
+#define BATCH_INSTRUCTION(name, mode, reg) \
+  [OP_##name] = { LENGTH_##mode, CYCLES_##mode, MODE_##mode, TARGET_##reg },
+
+static const batchInstruction batchInstructions[256] = {
+  INSTRUCTIONS(BATCH_INSTRUCTION)
+};
+
+// Runs one decoded instruction on every lane in mask. The loops cover all
+// BATCH_LANES, with the unused lanes masked off, so their trip count is
+// fixed and the mode is tested once outside them.
+static void runGroup(Batch *batch, const byte *mask, const batchInstruction *instruction, word operand) {
+  word address[BATCH_LANES];
+  byte value[BATCH_LANES];
+  byte penalty[BATCH_LANES] = { 0 };
+  const byte *index = batch->X;
+
+  // Effective addresses and page crossing penalties
+  switch(instruction->mode) {
+    case MODE_ZPY:
+      index = batch->Y;
+      // Fall through
+    case MODE_ZPX:
+      for(uint lane = 0; lane < BATCH_LANES; lane++) {
+        address[lane] = (operand + index[lane]) & 0xFF;
+      }
+      break;
+    case MODE_ABSY:
+      index = batch->Y;
+      // Fall through
+    case MODE_ABSX:
+      for(uint lane = 0; lane < BATCH_LANES; lane++) {
+        address[lane] = operand + index[lane];
+        penalty[lane] = (address[lane] >> 8) != 0x00;
+      }
+      break;
+    default:
+      for(uint lane = 0; lane < BATCH_LANES; lane++) {
+        address[lane] = operand;
+      }
+      break;
+  }
+
+  // Loads, one bus access per lane
+  if(instruction->mode == MODE_IM) {
+    for(uint lane = 0; lane < BATCH_LANES; lane++) {
+      value[lane] = operand;
+    }
+  } else {
+    for(uint lane = 0; lane < BATCH_LANES; lane++) {
+      value[lane] = mask[lane] ? busRead(batch->memory[lane], address[lane]) : 0;
+    }
+  }
+
+  // Register, flags, PC and cycles, blended by the mask without branches
+  byte *target = instruction->target == TARGET_A ? batch->A :
+    instruction->target == TARGET_X ? batch->X : batch->Y;
+  for(uint lane = 0; lane < BATCH_LANES; lane++) {
+    target[lane] ^= (target[lane] ^ value[lane]) & -mask[lane];
+  }
+  for(uint lane = 0; lane < BATCH_LANES; lane++) {
+    byte flags = (batch->PS[lane] & ~(ZERO_FLAG | NEGATIVE_FLAG)) |
+      (value[lane] == 0) * ZERO_FLAG | (value[lane] & NEGATIVE_FLAG);
+    batch->PS[lane] ^= (batch->PS[lane] ^ flags) & -mask[lane];
+  }
+  for(uint lane = 0; lane < BATCH_LANES; lane++) {
+    batch->PC[lane] += instruction->length & -(word)mask[lane];
+  }
+  for(uint lane = 0; lane < BATCH_LANES; lane++) {
+    batch->cycles[lane] -= (instruction->cycles + penalty[lane]) & -(uint)mask[lane];
+  }
+}
+
+// Runs one instruction of a lane the kernels can't handle
+static void stepLane(Batch *batch, uint lane) {
+  CPU cpu;
+  getLane(batch, lane, &cpu);
+  step(&cpu, batch->memory[lane], &batch->cycles[lane]);
+  setLane(batch, lane, &cpu, batch->memory[lane], batch->cycles[lane]);
+}
+
+/*
+ * Execution
+ */
+
+// Whether the instruction's bytes can be compared without touching a device,
+// whose reads may have side effects
+static byte codeInRAM(const Memory *memory, word PC, byte length) {
+  return memory->readMap[PC >> 8] != NULL &&
+    memory->readMap[(word)(PC + length - 1) >> 8] != NULL;
+}
+
+void executeBatch(Batch *batch) {
+  byte mask[BATCH_LANES] = { 0 }; // Lanes past batch->lanes stay off
+
+  for(;;) {
+    // The first lane with cycles left leads the group
+    uint leader = batch->lanes;
+    for(uint lane = 0; lane < batch->lanes; lane++) {
+      if(cyclesLeft(batch->cycles[lane])) {
+        leader = lane;
+        break;
+      }
+    }
+    if(leader == batch->lanes)
+      return;
+
+    // Code in device pages runs through step(), which reads it only once
+    word PC = batch->PC[leader];
+    const Memory *memory = batch->memory[leader];
+    if(memory->readMap[PC >> 8] == NULL) {
+      stepLane(batch, leader);
+      continue;
+    }
+
+    byte opcode = busRead(memory, PC);
+    const batchInstruction *instruction = &batchInstructions[opcode];
+    if(instruction->length == 0 || !codeInRAM(memory, PC, instruction->length)) {
+      stepLane(batch, leader);
+      continue;
+    }
+
+    word operand = busRead(memory, PC + 1);
+    if(instruction->length == 3)
+      operand |= busRead(memory, PC + 2) << 8;
+
+    // Lanes at the same PC, with the same code there, and budget left
+    for(uint lane = 0; lane < batch->lanes; lane++) {
+      const Memory *laneMemory = batch->memory[lane];
+      mask[lane] = cyclesLeft(batch->cycles[lane]) && batch->PC[lane] == PC &&
+        codeInRAM(laneMemory, PC, instruction->length) &&
+        busRead(laneMemory, PC) == opcode &&
+        busRead(laneMemory, PC + 1) == (operand & 0xFF) &&
+        (instruction->length < 3 || busRead(laneMemory, PC + 2) == operand >> 8);
+    }
+
+    runGroup(batch, mask, instruction, operand);
+  }
+}
+
+#endif
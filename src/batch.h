@@ -0,0 +1,50 @@
+#ifndef C6502_BATCH_H
+#define C6502_BATCH_H
+
+#include "6502.h"
+
+/*
+ * BATCH
+ *
+ * Runs up to BATCH_LANES independent CPUs in lockstep, for running the same
+ * program over many inputs. Registers are kept as structure of arrays. On
+ * each step the lanes sitting on the same instruction are grouped under a
+ * mask, the instruction is decoded once, and the group is updated with
+ * branch-free loops over all the lanes, which GCC vectorizes at -O2. Bus
+ * reads, and the check that a lane holds the same code, stay one lane at a
+ * time since each lane has its own memory.
+ *
+ * Lanes that diverge (a different PC, different code bytes, or a spent
+ * budget) are masked off and catch up in their own groups. Opcodes without
+ * a batch kernel, and code in device pages, run through step() one lane at
+ * a time.
+ *
+ * Experimental, built only with -DBATCH_ENGINE (make ENGINES=batch). With
+ * bus reads and code checks still per lane, it runs about 1.0-1.5x the
+ * throughput of execute().
+ */
+
+#define BATCH_LANES 32
+
+typedef struct {
+  uint lanes;
+  word PC[BATCH_LANES];
+  byte SP[BATCH_LANES];
+  byte A[BATCH_LANES];
+  byte X[BATCH_LANES];
+  byte Y[BATCH_LANES];
+  byte PS[BATCH_LANES];
+  uint cycles[BATCH_LANES];
+  Memory *memory[BATCH_LANES];
+} Batch;
+
+#ifdef BATCH_ENGINE
+
+void initBatch(Batch *batch, uint lanes);
+void setLane(Batch *batch, uint lane, const CPU *cpu, Memory *memory, uint cycles);
+void getLane(const Batch *batch, uint lane, CPU *cpu);
+void executeBatch(Batch *batch);
+
+#endif
+
+#endif
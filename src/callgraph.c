@@ -0,0 +1,193 @@
+#include "callgraph.h"
+#include <stdlib.h>
+#include <string.h>
+
+void initCallProfiler(CallProfiler *profiler, const CPU *cpu) {
+  profiler->clock = 0;
+  profiler->frames[0].routine = cpu->PC;
+  profiler->frames[0].SP = cpu->SP;
+  profiler->frames[0].start = 0;
+  profiler->depth = 1;
+  profiler->lostFrames = 0;
+  profiler->lostEdges = 0;
+  memset(profiler->routines, 0, sizeof(profiler->routines));
+  memset(profiler->edges, 0, sizeof(profiler->edges));
+  profiler->routines[cpu->PC].active = 1;
+  initSymbols(&profiler->symbols);
+}
+
+void freeCallProfiler(CallProfiler *profiler) {
+  freeSymbols(&profiler->symbols);
+}
+
+/*
+ * Shadow stack
+ */
+
+// Finds or adds the edge, NULL when the table is full
+static CallEdge *findEdge(CallProfiler *profiler, word caller, word callee) {
+  uint index = ((caller * 40503u) ^ callee) & (CALL_GRAPH_EDGES - 1);
+
+  for(uint probe = 0; probe < CALL_GRAPH_EDGES; probe++) {
+    CallEdge *edge = &profiler->edges[(index + probe) & (CALL_GRAPH_EDGES - 1)];
+    if(!edge->used) {
+      edge->used = 1;
+      edge->caller = caller;
+      edge->callee = callee;
+      return edge;
+    }
+    if(edge->caller == caller && edge->callee == callee)
+      return edge;
+  }
+  return NULL;
+}
+
+static void pushFrame(CallProfiler *profiler, word routine, byte SP) {
+  if(profiler->depth == CALL_STACK_DEPTH) {
+    profiler->lostFrames++;
+    return;
+  }
+
+  CallEdge *edge = findEdge(profiler, profiler->frames[profiler->depth - 1].routine, routine);
+  if(edge != NULL)
+    edge->calls++;
+  else
+    profiler->lostEdges++;
+
+  CallFrame *frame = &profiler->frames[profiler->depth++];
+  frame->routine = routine;
+  frame->SP = SP;
+  frame->start = profiler->clock;
+  profiler->routines[routine].calls++;
+  profiler->routines[routine].active++;
+}
+
+static void popFrame(CallProfiler *profiler) {
+  CallFrame *frame = &profiler->frames[--profiler->depth];
+  RoutineCounter *routine = &profiler->routines[frame->routine];
+  uint64_t cycles = profiler->clock - frame->start;
+
+  if(--routine->active == 0)
+    routine->inclusive += cycles;
+
+  CallEdge *edge = findEdge(profiler, profiler->frames[profiler->depth - 1].routine, frame->routine);
+  if(edge != NULL)
+    edge->cycles += cycles;
+}
+
+// Pops the frames whose JSR the stack pointer is back above. The difference
+// is taken as signed so a stack that wraps around page 1 still compares.
+static void unwind(CallProfiler *profiler, byte SP) {
+  while(profiler->depth > 1 &&
+      (signed char)(SP - profiler->frames[profiler->depth - 1].SP) >= 0) {
+    popFrame(profiler);
+  }
+}
+
+void executeCallProfiled(CallProfiler *profiler, CPU *cpu, Memory *memory, uint *cycles) {
+  while(cyclesLeft(*cycles)) {
+    byte opcode = busRead(memory, cpu->PC);
+    byte SP = cpu->SP;
+    uint before = *cycles;
+    step(cpu, memory, cycles);
+
+    uint spent = before - *cycles;
+    profiler->routines[profiler->frames[profiler->depth - 1].routine].exclusive += spent;
+    profiler->clock += spent;
+
+    if(opcode == OP_JSR)
+      pushFrame(profiler, cpu->PC, SP);
+    unwind(profiler, cpu->SP);
+  }
+}
+
+uint64_t routineInclusive(const CallProfiler *profiler, word routine) {
+  uint64_t inclusive = profiler->routines[routine].inclusive;
+
+  // The outermost open frame of the routine, if any
+  for(uint i = 0; i < profiler->depth; i++) {
+    if(profiler->frames[i].routine == routine)
+      return inclusive + profiler->clock - profiler->frames[i].start;
+  }
+  return inclusive;
+}
+
+/*
+ * Reports
+ */
+
+typedef struct {
+  word routine;
+  uint64_t inclusive;
+} ProfileRow;
+
+static int compareRows(const void *a, const void *b) {
+  const ProfileRow *x = a, *y = b;
+  if(x->inclusive != y->inclusive)
+    return x->inclusive < y->inclusive ? 1 : -1;
+  return (int)x->routine - (int)y->routine;
+}
+
+// The symbol at the routine's entry, or its address
+static const char *routineName(const CallProfiler *profiler, word routine, char *buffer) {
+  const char *name = symbolAt(&profiler->symbols, routine);
+  if(name != NULL)
+    return name;
+  sprintf(buffer, "$%04X", routine);
+  return buffer;
+}
+
+// Routines by inclusive cycles, most first
+void writeCallProfile(const CallProfiler *profiler, FILE *out) {
+  ProfileRow *rows = malloc(MEMORY_SIZE * sizeof(ProfileRow));
+  if(rows == NULL)
+    return;
+
+  uint count = 0;
+  for(uint routine = 0; routine < MEMORY_SIZE; routine++) {
+    const RoutineCounter *counter = &profiler->routines[routine];
+    if(counter->calls > 0 || counter->exclusive > 0 || counter->active > 0) {
+      rows[count].routine = routine;
+      rows[count].inclusive = routineInclusive(profiler, routine);
+      count++;
+    }
+  }
+  qsort(rows, count, sizeof(ProfileRow), compareRows);
+
+  fprintf(out, "%10s %14s %14s %8s  %s\n", "calls", "inclusive", "exclusive", "percent", "routine");
+  for(uint i = 0; i < count; i++) {
+    char buffer[8];
+    const RoutineCounter *counter = &profiler->routines[rows[i].routine];
+    fprintf(out, "%10llu %14llu %14llu %7.2f%%  %s\n",
+      (unsigned long long)counter->calls,
+      (unsigned long long)rows[i].inclusive,
+      (unsigned long long)counter->exclusive,
+      profiler->clock ? rows[i].inclusive * 100.0 / profiler->clock : 0.0,
+      routineName(profiler, rows[i].routine, buffer));
+  }
+  free(rows);
+}
+
+// Graphviz dot: one node per routine with its cycles, one edge per caller
+// and callee pair with its calls
+void writeCallGraph(const CallProfiler *profiler, FILE *out) {
+  fprintf(out, "digraph calls {\n  node [shape=box];\n");
+  for(uint routine = 0; routine < MEMORY_SIZE; routine++) {
+    const RoutineCounter *counter = &profiler->routines[routine];
+    if(counter->calls == 0 && counter->exclusive == 0 && counter->active == 0)
+      continue;
+
+    char buffer[8];
+    fprintf(out, "  r%04X [label=\"%s\\ninclusive %llu\\nexclusive %llu\"];\n",
+      routine, routineName(profiler, routine, buffer),
+      (unsigned long long)routineInclusive(profiler, routine),
+      (unsigned long long)counter->exclusive);
+  }
+  for(uint i = 0; i < CALL_GRAPH_EDGES; i++) {
+    const CallEdge *edge = &profiler->edges[i];
+    if(edge->used)
+      fprintf(out, "  r%04X -> r%04X [label=\"%llu\"];\n",
+        edge->caller, edge->callee, (unsigned long long)edge->calls);
+  }
+  fprintf(out, "}\n");
+}
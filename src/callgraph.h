@@ -0,0 +1,68 @@
+#ifndef C6502_CALLGRAPH_H
+#define C6502_CALLGRAPH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "6502.h"
+#include "symbols.h"
+
+/*
+ * CALL GRAPH PROFILER
+ *
+ * Runs the CPU one instruction at a time and keeps a shadow call stack of
+ * the JSRs taken. Each instruction's cycles are exclusive time of the
+ * routine on top of the shadow stack. The inclusive time of a routine runs
+ * from its outermost entry to its exit, so recursion isn't counted twice.
+ *
+ * Frames are popped when SP rises back to where it was before their JSR,
+ * instead of on RTS. Code that returns through a pushed address, drops a
+ * return address or reloads SP unwinds the shadow stack along with the real
+ * one, and the totals stay consistent.
+ */
+
+#define CALL_STACK_DEPTH 256
+#define CALL_GRAPH_EDGES 4096 // Must be a power of two
+
+typedef struct {
+  word routine; // Entry address
+  byte SP; // SP before the JSR
+  uint64_t start; // clock on entry
+} CallFrame;
+
+typedef struct {
+  uint64_t calls;
+  uint64_t inclusive; // Of completed outermost calls, see routineInclusive()
+  uint64_t exclusive;
+  uint active; // Frames of the routine on the shadow stack
+} RoutineCounter;
+
+typedef struct {
+  word caller;
+  word callee;
+  uint64_t calls;
+  uint64_t cycles; // Callee's inclusive cycles, summed over completed calls
+  byte used;
+} CallEdge;
+
+typedef struct {
+  uint64_t clock; // Cycles run
+  CallFrame frames[CALL_STACK_DEPTH]; // frames[0] is where profiling started
+  uint depth;
+  uint lostFrames; // Calls past CALL_STACK_DEPTH, counted as their caller
+  uint lostEdges; // Calls along edges that didn't fit in edges
+  RoutineCounter routines[MEMORY_SIZE];
+  CallEdge edges[CALL_GRAPH_EDGES];
+  SymbolTable symbols; // Names the routines in reports
+} CallProfiler;
+
+void initCallProfiler(CallProfiler *profiler, const CPU *cpu);
+void freeCallProfiler(CallProfiler *profiler);
+void executeCallProfiled(CallProfiler *profiler, CPU *cpu, Memory *memory, uint *cycles);
+
+// Inclusive cycles so far, counting routines that are still running
+uint64_t routineInclusive(const CallProfiler *profiler, word routine);
+
+void writeCallProfile(const CallProfiler *profiler, FILE *out);
+void writeCallGraph(const CallProfiler *profiler, FILE *out);
+
+#endif
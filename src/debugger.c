@@ -0,0 +1,124 @@
+#include "debugger.h"
+#include <string.h>
+
+const byte noWatches[MEMORY_PAGES];
+
+void attachDebugger(Memory *memory, Debugger *debugger) {
+  memset(debugger, 0, sizeof(Debugger));
+  debugger->stop = STOP_BUDGET;
+  memory->debugger = debugger;
+  memory->watchPages = debugger->pages;
+}
+
+void detachDebugger(Memory *memory) {
+  memory->debugger = NULL;
+  memory->watchPages = noWatches;
+}
+
+/*
+ * Watches
+ */
+
+// One bitmap per kind: WATCH_EXECUTE, WATCH_READ and WATCH_WRITE are 1, 2, 4
+#define BITMAP(kind) ((kind) >> 1)
+
+void setWatch(Debugger *debugger, word address, byte kinds) {
+  for(byte kind = WATCH_EXECUTE; kind <= WATCH_WRITE; kind <<= 1) {
+    if(kinds & kind) {
+      debugger->bitmaps[BITMAP(kind)][address >> 3] |= 1 << (address & 7);
+      debugger->pages[address >> 8] |= kind;
+    }
+  }
+}
+
+void clearWatch(Debugger *debugger, word address, byte kinds) {
+  uint first = (address >> 8) * (MEMORY_PAGE_SIZE / 8);
+
+  for(byte kind = WATCH_EXECUTE; kind <= WATCH_WRITE; kind <<= 1) {
+    if(!(kinds & kind))
+      continue;
+    byte *bitmap = debugger->bitmaps[BITMAP(kind)];
+    bitmap[address >> 3] &= ~(1 << (address & 7));
+
+    // The page keeps the flag while any of its addresses has the kind
+    byte left = 0;
+    for(uint i = first; i < first + MEMORY_PAGE_SIZE / 8; i++) {
+      left |= bitmap[i];
+    }
+    if(!left)
+      debugger->pages[address >> 8] &= ~kind;
+  }
+}
+
+byte isWatched(const Debugger *debugger, word address, byte kind) {
+  return (debugger->bitmaps[BITMAP(kind)][address >> 3] >> (address & 7)) & 1;
+}
+
+/*
+ * Running
+ */
+
+static void setStopFlags(Debugger *debugger, byte set) {
+  for(uint page = 0; page < MEMORY_PAGES; page++) {
+    debugger->pages[page] = set ?
+      debugger->pages[page] | WATCH_STOP :
+      debugger->pages[page] & ~WATCH_STOP;
+  }
+}
+
+// Forgets the last stop, except to step over its breakpoint
+static void resumeDebugger(Debugger *debugger, word PC) {
+  debugger->resuming = debugger->stop == STOP_BREAKPOINT && debugger->address == PC;
+  if(debugger->pages[0] & WATCH_STOP)
+    setStopFlags(debugger, 0);
+  debugger->stop = STOP_BUDGET;
+}
+
+// Called before every instruction on a page with WATCH_EXECUTE or WATCH_STOP
+static StopReason checkStops(Debugger *debugger, word PC) {
+  if(debugger->stop != STOP_BUDGET) {
+    setStopFlags(debugger, 0);
+    return debugger->stop;
+  }
+
+  if(debugger->resuming) {
+    debugger->resuming = 0;
+    if(PC == debugger->address)
+      return STOP_BUDGET;
+  }
+
+  if(isWatched(debugger, PC, WATCH_EXECUTE)) {
+    debugger->stop = STOP_BREAKPOINT;
+    debugger->address = PC;
+  }
+  return debugger->stop;
+}
+
+StopReason executeDebugged(CPU *cpu, Memory *memory, uint *cycles, uint64_t *instructionCount) {
+  Debugger *debugger = memory->debugger;
+  StopReason stop = STOP_BUDGET;
+  resumeDebugger(debugger, cpu->PC);
+
+  for(;;) {
+    if((debugger->pages[cpu->PC >> 8] & (WATCH_EXECUTE | WATCH_STOP)) &&
+        (stop = checkStops(debugger, cpu->PC)) != STOP_BUDGET)
+      break;
+    if(!cyclesLeft(*cycles))
+      break;
+    stepWatched(cpu, memory, cycles);
+    (*instructionCount)++;
+  }
+  return stop;
+}
+
+// Records the first hit of an instruction. WATCH_STOP on every page makes
+// executeDebugged() call checkStops() before the next one, wherever it is.
+void watchHit(const Memory *memory, word address, byte kind) {
+  Debugger *debugger = memory->debugger;
+  if(debugger->stop != STOP_BUDGET || !isWatched(debugger, address, kind))
+    return;
+
+  debugger->stop = kind == WATCH_READ ? STOP_READ : STOP_WRITE;
+  debugger->address = address;
+  setStopFlags(debugger, 1);
+}
@@ -0,0 +1,75 @@
+#ifndef C6502_DEBUGGER_H
+#define C6502_DEBUGGER_H
+
+#include "6502.h"
+
+/*
+ * DEBUGGER
+ *
+ * Breakpoints and watchpoints for execute(). Every address has one bit in
+ * each of three 64 Kbit bitmaps: execute, read and write. On top of them,
+ * pages keeps one byte per page with the WATCH_* kinds any of its addresses
+ * has. The interpreter only tests the page byte, so code and data on pages
+ * with nothing set never reach a bitmap. Memory.watchPages points at the
+ * page flags of the attached debugger, or at noWatches when there is none.
+ *
+ * A breakpoint stops execute() before the instruction at its address runs.
+ * Calling execute() again at that PC runs the instruction, so a caller can
+ * continue from a breakpoint without clearing it. A watchpoint stops it
+ * after the instruction that read or wrote the address, and data reads,
+ * stack pulls and stack pushes all count. Operand fetches don't, and neither
+ * do accesses made through readByte/writeByte.
+ *
+ * While a debugger is attached, execute() hands the run to executeDebugged(),
+ * which tests the PC's page before each instruction and runs it through
+ * stepWatched(), whose handlers test the page of every data access. The
+ * handlers of execute() and step() have neither test, so runs without a
+ * debugger don't pay for them. The debugged loop isn't traced or counted by
+ * the opcode statistics.
+ *
+ * Only execute() stops, and the runners built on it pass the stop on.
+ * step(), executeTable() and the translators run
+ * through breakpoints, and an access they make isn't reported.
+ */
+
+#define WATCH_EXECUTE 0x01
+#define WATCH_READ 0x02
+#define WATCH_WRITE 0x04
+#define WATCH_STOP 0x08 // Set on every page by a watch hit, see watchHit()
+
+typedef struct Debugger {
+  byte pages[MEMORY_PAGES];
+  byte bitmaps[3][MEMORY_SIZE / 8]; // Execute, read and write
+  StopReason stop; // Why the last execute() returned
+  word address; // Breakpoint or watched address of the last stop
+  byte resuming; // Whether execute() started at the last breakpoint
+} Debugger;
+
+extern const byte noWatches[MEMORY_PAGES];
+
+// Clears every watch before attaching
+void attachDebugger(Memory *memory, Debugger *debugger);
+void detachDebugger(Memory *memory);
+
+// kinds is any combination of WATCH_EXECUTE, WATCH_READ and WATCH_WRITE
+void setWatch(Debugger *debugger, word address, byte kinds);
+void clearWatch(Debugger *debugger, word address, byte kinds);
+byte isWatched(const Debugger *debugger, word address, byte kind);
+
+// Runs executeCounted() while a debugger is attached
+StopReason executeDebugged(CPU *cpu, Memory *memory, uint *cycles, uint64_t *instructionCount);
+
+// Runs one instruction like step(), through handlers that report its data
+// accesses with WATCH_ACCESS. Defined in 6502.c with the other handlers.
+void stepWatched(CPU *cpu, Memory *memory, uint *cycles);
+
+// Data access hook of the watched handlers. Records a hit when the address
+// is watched for the kind of access.
+void watchHit(const Memory *memory, word address, byte kind);
+
+#define WATCH_ACCESS(memory, kind, address) do { \
+  if((memory)->watchPages[(address) >> 8] & (kind)) \
+    watchHit(memory, address, kind); \
+} while(0)
+
+#endif
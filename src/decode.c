@@ -0,0 +1,207 @@
+#include "decode.h"
+#include "superinstructions.h"
+#include <stddef.h>
+
+/*
+ * Operand access
+ *
+ * One function per addressing mode, taking the already decoded operand.
+ * Cycles are charged up front from the base count, only the ABSX and ABSY
+ * penalty is left to these.
+ */
+
+static inline byte operandIM(CPU *cpu, Memory *memory, word operand, uint *cycles) {
+  return operand;
+}
+
+static inline byte operandZP(CPU *cpu, Memory *memory, word operand, uint *cycles) {
+  return busRead(memory, operand);
+}
+
+static inline byte operandZPX(CPU *cpu, Memory *memory, word operand, uint *cycles) {
+  return busRead(memory, (operand + cpu->X) % 256);
+}
+
+static inline byte operandZPY(CPU *cpu, Memory *memory, word operand, uint *cycles) {
+  return busRead(memory, (operand + cpu->Y) % 256);
+}
+
+static inline byte operandABS(CPU *cpu, Memory *memory, word operand, uint *cycles) {
+  return busRead(memory, operand);
+}
+
+static inline byte operandABSX(CPU *cpu, Memory *memory, word operand, uint *cycles) {
+  word address = operand + cpu->X;
+  if(address >> 8)
+    (*cycles)--;
+  return busRead(memory, address);
+}
+
+static inline byte operandABSY(CPU *cpu, Memory *memory, word operand, uint *cycles) {
+  word address = operand + cpu->Y;
+  if(address >> 8)
+    (*cycles)--;
+  return busRead(memory, address);
+}
+
+/*
+ * Decoded handlers
+ */
+
+#define DECODED_BODY(name, mode, reg) \
+  static inline void run_##name(CPU *cpu, Memory *memory, word operand, uint *cycles) { \
+    cpu->reg = operand##mode(cpu, memory, operand, cycles); \
+    setNZ(cpu, cpu->reg); \
+  }
+
+INSTRUCTIONS(DECODED_BODY)
+
+#define DECODED_HANDLER(name, mode, reg) \
+  static void DECODED_##name(CPU *cpu, Memory *memory, \
+      const DecodedInstruction *instruction, uint *cycles) { \
+    run_##name(cpu, memory, instruction->operand, cycles); \
+  }
+
+INSTRUCTIONS(DECODED_HANDLER)
+
+/*
+ * Superinstructions
+ *
+ * The caller has moved PC past the first instruction and charged its
+ * cycles, the handler does the same for the second.
+ */
+
+#define FUSED_HANDLER(first, second) \
+  static void FUSED_##first##_##second(CPU *cpu, Memory *memory, \
+      const DecodedInstruction *instruction, uint *cycles) { \
+    run_##first(cpu, memory, instruction->operand, cycles); \
+    if(!cyclesLeft(*cycles)) \
+      return; \
+    cpu->PC += instruction->nextLength; \
+    *cycles -= instruction->nextCycles; \
+    run_##second(cpu, memory, instruction->nextOperand, cycles); \
+  }
+
+SUPERINSTRUCTIONS(FUSED_HANDLER)
+
+#define FUSED_CASE(first, second) \
+  case OP_##first << 8 | OP_##second: return FUSED_##first##_##second;
+
+// Returns NULL when the pair isn't fused
+static decodedHandler fusedHandler(byte first, byte second) {
+  switch(first << 8 | second) {
+    SUPERINSTRUCTIONS(FUSED_CASE)
+  }
+  return NULL;
+}
+
+typedef struct {
+  decodedHandler handler;
+  byte length;
+  byte cycles;
+} decodedInstructionInfo;
+
+#define DECODED_INFO(name, mode, reg) \
+  [OP_##name] = { DECODED_##name, LENGTH_##mode, CYCLES_##mode },
+
+static const decodedInstructionInfo decodedInstructions[256] = {
+  INSTRUCTIONS(DECODED_INFO)
+};
+
+/*
+ * Cache management
+ */
+
+static void flushPage(DecodeCache *cache, const Memory *memory, byte page) {
+  DecodedInstruction *instructions = &cache->instructions[page << 8];
+  for(int i = 0; i < MEMORY_PAGE_SIZE; i++) {
+    instructions[i].handler = NULL;
+  }
+  cache->generation[page] = memory->codeGeneration[page];
+}
+
+void initDecodeCache(DecodeCache *cache) {
+  for(int i = 0; i < MEMORY_SIZE; i++) {
+    cache->instructions[i].handler = NULL;
+  }
+  for(int i = 0; i < MEMORY_PAGES; i++) {
+    cache->generation[i] = 0;
+  }
+}
+
+static word decodeOperand(Memory *memory, word PC, byte length) {
+  word operand = busRead(memory, PC + 1);
+  if(length == 3)
+    operand |= busRead(memory, PC + 2) << 8;
+  return operand;
+}
+
+// Fuses the instruction with the next one when they make a superinstruction
+// and the next one ends in the same page
+static void fuse(DecodedInstruction *instruction, Memory *memory, word PC) {
+  uint next = (PC & 0xFF) + instruction->length;
+  if(next >= MEMORY_PAGE_SIZE)
+    return;
+
+  byte opcode = busRead(memory, PC + instruction->length);
+  const decodedInstructionInfo *info = &decodedInstructions[opcode];
+  decodedHandler handler = fusedHandler(instruction->opcode, opcode);
+  if(handler == NULL || next + info->length > MEMORY_PAGE_SIZE)
+    return;
+
+  instruction->nextLength = info->length;
+  instruction->nextCycles = info->cycles;
+  instruction->nextOperand = decodeOperand(memory, PC + instruction->length, info->length);
+  instruction->handler = handler;
+}
+
+// Decodes the instruction at PC. Returns NULL for unknown opcodes, for
+// instructions that straddle a page boundary and for code in device pages.
+static DecodedInstruction *decode(DecodeCache *cache, Memory *memory, word PC) {
+  if(memory->readMap[PC >> 8] == NULL)
+    return NULL;
+
+  byte opcode = busRead(memory, PC);
+  const decodedInstructionInfo *info = &decodedInstructions[opcode];
+  if(info->handler == NULL || (PC & 0xFF) + info->length > MEMORY_PAGE_SIZE)
+    return NULL;
+
+  DecodedInstruction *instruction = &cache->instructions[PC];
+  instruction->opcode = opcode;
+  instruction->length = info->length;
+  instruction->cycles = info->cycles;
+  instruction->operand = decodeOperand(memory, PC, info->length);
+  instruction->nextLength = 0;
+  instruction->handler = info->handler;
+  fuse(instruction, memory, PC);
+  markCode(memory, PC);
+
+  return instruction;
+}
+
+/*
+ * Execution
+ */
+
+void executeDecoded(DecodeCache *cache, CPU *cpu, Memory *memory, uint *cycles) {
+  while(cyclesLeft(*cycles)) {
+    word PC = cpu->PC;
+    byte page = PC >> 8;
+    if(cache->generation[page] != memory->codeGeneration[page])
+      flushPage(cache, memory, page);
+
+    DecodedInstruction *instruction = &cache->instructions[PC];
+    if(instruction->handler == NULL)
+      instruction = decode(cache, memory, PC);
+
+    if(instruction == NULL) {
+      step(cpu, memory, cycles);
+      continue;
+    }
+
+    cpu->PC = PC + instruction->length;
+    *cycles -= instruction->cycles;
+    instruction->handler(cpu, memory, instruction, cycles);
+  }
+  syncPS(cpu);
+}
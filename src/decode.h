@@ -0,0 +1,48 @@
+#ifndef C6502_DECODE_H
+#define C6502_DECODE_H
+
+#include "6502.h"
+
+/*
+ * DECODE CACHE
+ *
+ * Keeps every executed PC in pre-decoded form: its opcode, a handler that
+ * takes the operand directly, the operand word and the base cycle count.
+ * Code runs from the cache instead of fetching operands byte by byte, and a
+ * page of entries is dropped when a write bumps its code generation.
+ *
+ * Instructions that straddle two pages are never cached, they go through the
+ * interpreter.
+ *
+ * An instruction followed by one it pairs with in SUPERINSTRUCTIONS gets a
+ * fused handler that runs both, saving a dispatch. The entry keeps the
+ * second operand, length and cycles, and the pair is only fused when both
+ * instructions lie in the same page, so flushing the page drops it. The
+ * second instruction still runs only when the first leaves some budget.
+ */
+
+struct DecodedInstruction;
+
+typedef void (*decodedHandler)(CPU *cpu, Memory *memory,
+  const struct DecodedInstruction *instruction, uint *cycles);
+
+typedef struct DecodedInstruction {
+  decodedHandler handler; // NULL until the PC is decoded
+  word operand;
+  byte opcode;
+  byte length;
+  byte cycles; // Without the page crossing penalty of ABSX and ABSY
+  byte nextLength; // Second instruction of a fused pair, 0 when not fused
+  byte nextCycles;
+  word nextOperand;
+} DecodedInstruction;
+
+typedef struct {
+  DecodedInstruction instructions[MEMORY_SIZE];
+  uint generation[MEMORY_PAGES]; // codeGeneration each page was decoded at
+} DecodeCache;
+
+void initDecodeCache(DecodeCache *cache);
+void executeDecoded(DecodeCache *cache, CPU *cpu, Memory *memory, uint *cycles);
+
+#endif
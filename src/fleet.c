@@ -0,0 +1,174 @@
+#define _DEFAULT_SOURCE // _SC_NPROCESSORS_ONLN
+
+#include "fleet.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Deques
+ *
+ * Job indices in [top, bottom). The owner pops at the bottom, thieves take
+ * from the top. A mutex per deque keeps this plain C99.
+ */
+
+typedef struct {
+  pthread_mutex_t lock;
+  uint *items;
+  uint top, bottom;
+} Deque;
+
+static byte popBottom(Deque *deque, uint *job) {
+  byte found = 0;
+  pthread_mutex_lock(&deque->lock);
+  if(deque->bottom > deque->top) {
+    *job = deque->items[--deque->bottom];
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+static byte stealTop(Deque *deque, uint *job) {
+  byte found = 0;
+  pthread_mutex_lock(&deque->lock);
+  if(deque->bottom > deque->top) {
+    *job = deque->items[deque->top++];
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+/*
+ * Workers
+ */
+
+typedef struct {
+  FleetJob *jobs;
+  Deque *deques;
+  uint workers;
+} Fleet;
+
+typedef struct {
+  Fleet *fleet;
+  uint index;
+  Machine *machine;
+} Worker;
+
+static void runJob(FleetJob *job, Machine *machine) {
+  initMemory(&machine->memory);
+  if(job->image != NULL) {
+    uint size = job->imageSize;
+    if(job->loadAddress + size > MEMORY_SIZE)
+      size = MEMORY_SIZE - job->loadAddress;
+    memcpy(&machine->memory.data[job->loadAddress], job->image, size);
+  }
+
+  // initMemory() detached any debugger, so execute() only returns once the
+  // budget runs out
+  machine->cpu = job->cpu;
+  execute(&machine->cpu, &machine->memory, &job->cycles);
+  job->cpu = machine->cpu;
+
+  if(job->finish != NULL)
+    job->finish(job, machine);
+}
+
+// Own jobs first, then steals, starting from the next worker along
+static byte nextJob(Worker *worker, uint *job) {
+  Fleet *fleet = worker->fleet;
+  if(popBottom(&fleet->deques[worker->index], job))
+    return 1;
+
+  for(uint i = 1; i < fleet->workers; i++) {
+    uint victim = (worker->index + i) % fleet->workers;
+    if(stealTop(&fleet->deques[victim], job))
+      return 1;
+  }
+  return 0;
+}
+
+static void *work(void *argument) {
+  Worker *worker = argument;
+  uint job;
+
+  while(nextJob(worker, &job)) {
+    runJob(&worker->fleet->jobs[job], worker->machine);
+  }
+  return NULL;
+}
+
+/*
+ * Fleet
+ */
+
+static uint onlineCores() {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores > 0 ? cores : 1;
+}
+
+byte runFleet(FleetJob *jobs, uint count, uint threads) {
+  if(threads == 0)
+    threads = onlineCores();
+  if(threads > count)
+    threads = count > 0 ? count : 1;
+
+  Fleet fleet = { jobs, calloc(threads, sizeof(Deque)), threads };
+  Worker *workers = calloc(threads, sizeof(Worker));
+  pthread_t *handles = calloc(threads, sizeof(pthread_t));
+  byte *started = calloc(threads, sizeof(byte));
+  uint *items = malloc((count > 0 ? count : 1) * sizeof(uint));
+
+  byte ok = fleet.deques != NULL && workers != NULL && handles != NULL &&
+    started != NULL && items != NULL;
+  for(uint i = 0; ok && i < threads; i++) {
+    workers[i].machine = malloc(sizeof(Machine));
+    ok = workers[i].machine != NULL;
+  }
+
+  if(ok) {
+    // Deal the jobs round-robin, each deque gets a contiguous slice of items
+    uint offset = 0;
+    for(uint i = 0; i < threads; i++) {
+      Deque *deque = &fleet.deques[i];
+      pthread_mutex_init(&deque->lock, NULL);
+      deque->items = &items[offset];
+      deque->top = deque->bottom = 0;
+      for(uint job = i; job < count; job += threads) {
+        deque->items[deque->bottom++] = job;
+      }
+      offset += deque->bottom;
+
+      workers[i].fleet = &fleet;
+      workers[i].index = i;
+    }
+
+    // Worker 0 is the calling thread. If a thread can't be started, its
+    // deque is simply left to the thieves.
+    for(uint i = 1; i < threads; i++) {
+      started[i] = pthread_create(&handles[i], NULL, work, &workers[i]) == 0;
+    }
+    work(&workers[0]);
+    for(uint i = 1; i < threads; i++) {
+      if(started[i])
+        pthread_join(handles[i], NULL);
+    }
+
+    for(uint i = 0; i < threads; i++) {
+      pthread_mutex_destroy(&fleet.deques[i].lock);
+    }
+  }
+
+  // Machines not allocated yet are still NULL from calloc
+  for(uint i = 0; workers != NULL && i < threads; i++) {
+    free(workers[i].machine);
+  }
+  free(items);
+  free(started);
+  free(handles);
+  free(workers);
+  free(fleet.deques);
+  return ok;
+}
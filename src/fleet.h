@@ -0,0 +1,36 @@
+#ifndef C6502_FLEET_H
+#define C6502_FLEET_H
+
+#include "6502.h"
+
+/*
+ * FLEET
+ *
+ * Runs a queue of independent jobs across worker threads. Jobs are dealt
+ * round-robin into one deque per worker; a worker takes from the back of
+ * its own deque and, once it is empty, steals from the front of the
+ * others. Each worker owns one preallocated Machine and reuses it for every
+ * job it runs.
+ */
+
+typedef struct FleetJob FleetJob;
+
+struct FleetJob {
+  const byte *image; // Copied into RAM at loadAddress before the job runs
+  uint imageSize;
+  word loadAddress;
+  CPU cpu; // Initial state, holds the final state afterwards
+  uint cycles; // Budget, holds the cycles left afterwards
+
+  // Optional, called on the worker thread once the job has run, while its
+  // machine still holds the job's memory
+  void (*finish)(FleetJob *job, Machine *machine);
+  void *context;
+};
+
+// Runs every job, with threads workers (0 for one per online core). The
+// calling thread works as well, and returns once all jobs are done. Returns
+// 0, without running any job, when the fleet can't be allocated.
+byte runFleet(FleetJob *jobs, uint count, uint threads);
+
+#endif
@@ -0,0 +1,123 @@
+#include "heatmap.h"
+#include <stdint.h>
+#include <string.h>
+
+#define HEATMAP_MAGIC "C6502HM1"
+
+#ifdef MEMORY_HEATMAP
+void attachHeatMap(Memory *memory, HeatMap *heatmap) {
+  memory->heatmap = heatmap;
+}
+#endif
+
+void clearHeatMap(HeatMap *heatmap) {
+  memset(heatmap, 0, sizeof(HeatMap));
+}
+
+/*
+ * Binary file
+ */
+
+static byte writeCounters(const uint *counters, FILE *file) {
+  byte buffer[MEMORY_PAGE_SIZE * 4];
+
+  for(uint page = 0; page < MEMORY_PAGES; page++) {
+    for(uint i = 0; i < MEMORY_PAGE_SIZE; i++) {
+      uint value = counters[(page << 8) | i];
+      buffer[i * 4] = value & 0xFF;
+      buffer[i * 4 + 1] = (value >> 8) & 0xFF;
+      buffer[i * 4 + 2] = (value >> 16) & 0xFF;
+      buffer[i * 4 + 3] = (value >> 24) & 0xFF;
+    }
+    if(fwrite(buffer, sizeof(buffer), 1, file) != 1)
+      return 0;
+  }
+  return 1;
+}
+
+static byte readCounters(uint *counters, FILE *file) {
+  byte buffer[MEMORY_PAGE_SIZE * 4];
+
+  for(uint page = 0; page < MEMORY_PAGES; page++) {
+    if(fread(buffer, sizeof(buffer), 1, file) != 1)
+      return 0;
+    for(uint i = 0; i < MEMORY_PAGE_SIZE; i++) {
+      counters[(page << 8) | i] = buffer[i * 4] |
+        (buffer[i * 4 + 1] << 8) |
+        (buffer[i * 4 + 2] << 16) |
+        ((uint)buffer[i * 4 + 3] << 24);
+    }
+  }
+  return 1;
+}
+
+byte writeHeatMap(const HeatMap *heatmap, FILE *file) {
+  return fwrite(HEATMAP_MAGIC, 8, 1, file) == 1 &&
+    writeCounters(heatmap->reads, file) &&
+    writeCounters(heatmap->writes, file) &&
+    writeCounters(heatmap->fetches, file);
+}
+
+byte readHeatMap(HeatMap *heatmap, FILE *file) {
+  char magic[8];
+  return fread(magic, 8, 1, file) == 1 &&
+    memcmp(magic, HEATMAP_MAGIC, 8) == 0 &&
+    readCounters(heatmap->reads, file) &&
+    readCounters(heatmap->writes, file) &&
+    readCounters(heatmap->fetches, file);
+}
+
+/*
+ * Image
+ */
+
+// log2(value + 1) in 256ths, linear between powers of two
+static uint logScale(uint value) {
+  uint64_t v = (uint64_t)value + 1;
+  uint bits = 0;
+  while((v >> bits) > 1)
+    bits++;
+
+  uint fraction = bits >= 8 ? (v >> (bits - 8)) & 0xFF : (v << (8 - bits)) & 0xFF;
+  return bits * 256 + fraction;
+}
+
+static uint maximum(const uint *counters) {
+  uint max = 0;
+  for(uint i = 0; i < MEMORY_SIZE; i++) {
+    if(counters[i] > max)
+      max = counters[i];
+  }
+  return max;
+}
+
+static byte intensity(uint value, uint scale) {
+  return (uint64_t)logScale(value) * 255 / scale;
+}
+
+byte writeHeatMapImage(const HeatMap *heatmap, FILE *file) {
+  uint writeScale = logScale(maximum(heatmap->writes));
+  uint readScale = logScale(maximum(heatmap->reads));
+  uint fetchScale = logScale(maximum(heatmap->fetches));
+  byte row[MEMORY_PAGE_SIZE * 3];
+
+  if(fprintf(file, "P6\n256 256\n255\n") < 0)
+    return 0;
+
+  // logScale(0) is 0, so an untouched channel stays black
+  writeScale = writeScale > 0 ? writeScale : 1;
+  readScale = readScale > 0 ? readScale : 1;
+  fetchScale = fetchScale > 0 ? fetchScale : 1;
+
+  for(uint page = 0; page < MEMORY_PAGES; page++) {
+    for(uint i = 0; i < MEMORY_PAGE_SIZE; i++) {
+      uint address = (page << 8) | i;
+      row[i * 3] = intensity(heatmap->writes[address], writeScale);
+      row[i * 3 + 1] = intensity(heatmap->reads[address], readScale);
+      row[i * 3 + 2] = intensity(heatmap->fetches[address], fetchScale);
+    }
+    if(fwrite(row, sizeof(row), 1, file) != 1)
+      return 0;
+  }
+  return 1;
+}
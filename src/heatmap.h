@@ -0,0 +1,32 @@
+#ifndef C6502_HEATMAP_H
+#define C6502_HEATMAP_H
+
+#include <stdio.h>
+#include "6502.h"
+
+/*
+ * HEAT MAP
+ *
+ * With -DMEMORY_HEATMAP, execute(), step() and executeTable() count every
+ * data read, operand or opcode fetch and write in the HeatMap attached to
+ * their Memory (see HEAT in 6502.h). Writes made through writeByte count
+ * too. The decode cache, the JIT and the batch interpreter skip the counters.
+ *
+ * Maps are saved as "C6502HM1" followed by the reads, writes and fetches
+ * arrays as little-endian 32-bit counters, and drawn as a 256x256 PPM image
+ * with one pixel per address, one row per page: red for writes, green for
+ * reads and blue for fetches, each on a log scale.
+ */
+
+#ifdef MEMORY_HEATMAP
+void attachHeatMap(Memory *memory, HeatMap *heatmap);
+#endif
+
+void clearHeatMap(HeatMap *heatmap);
+
+// All return 1 on success, 0 on an I/O error or a bad file
+byte writeHeatMap(const HeatMap *heatmap, FILE *file);
+byte readHeatMap(HeatMap *heatmap, FILE *file);
+byte writeHeatMapImage(const HeatMap *heatmap, FILE *file);
+
+#endif
@@ -0,0 +1,283 @@
+#if defined(__x86_64__) && defined(__linux__)
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#endif
+
+#include "jit.h"
+#include <stddef.h>
+
+#ifdef JIT_NATIVE
+#include <sys/mman.h>
+#endif
+
+/*
+ * Translation tables
+ */
+
+typedef struct {
+  byte length; // Instruction bytes, 0 when the opcode can't be translated
+  byte cycles; // Without the page crossing penalty of ABSX and ABSY
+  byte mode;
+  byte target; // Offset of the loaded register in CPU
+} jitInstruction;
+
+#define JIT_INSTRUCTION(name, mode, reg) \
+  [OP_##name] = { LENGTH_##mode, CYCLES_##mode, MODE_##mode, offsetof(CPU, reg) },
+
+static const jitInstruction jitInstructions[256] = {
+  INSTRUCTIONS(JIT_INSTRUCTION)
+};
+
+// Worst case native code for one block
+#define JIT_MAX_BLOCK_BYTES (64 * JIT_MAX_INSTRUCTIONS + 16)
+
+/*
+ * Cache management
+ */
+
+byte initJIT(JIT *jit) {
+  jit->buffer = NULL;
+  jit->used = 0;
+  jit->mapGeneration = 0;
+  flushJIT(jit);
+
+#ifdef JIT_NATIVE
+  void *buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(buffer != MAP_FAILED)
+    jit->buffer = buffer;
+#endif
+
+  return jit->buffer != NULL;
+}
+
+void freeJIT(JIT *jit) {
+#ifdef JIT_NATIVE
+  if(jit->buffer != NULL)
+    munmap(jit->buffer, JIT_BUFFER_SIZE);
+#endif
+  jit->buffer = NULL;
+}
+
+void flushJIT(JIT *jit) {
+  for(int i = 0; i < JIT_CACHE_SIZE; i++) {
+    jit->blocks[i].code = NULL;
+    jit->blocks[i].PC = 0;
+    jit->blocks[i].hits = 0;
+  }
+  jit->used = 0;
+}
+
+// Finds the cache entry for a PC, dropping the translation if it is stale
+static JITBlock *lookupBlock(JIT *jit, const Memory *memory, word PC) {
+  JITBlock *block = &jit->blocks[PC & (JIT_CACHE_SIZE - 1)];
+
+  if(block->PC != PC) {
+    block->code = NULL;
+    block->PC = PC;
+    block->hits = 0;
+  } else if(block->code != NULL &&
+      (block->generation[0] != memory->codeGeneration[block->PC >> 8] ||
+       block->generation[1] != memory->codeGeneration[block->lastPC >> 8])) {
+    block->code = NULL;
+  }
+
+  return block;
+}
+
+#ifdef JIT_NATIVE
+
+/*
+ * x86-64 code generation
+ *
+ * Generated blocks follow the System V calling convention for jitCode:
+ * rdi = CPU, rsi = memory data, rdx = cycles. Only caller-saved registers
+ * (rax, rcx) are used.
+ */
+
+typedef struct {
+  byte *out;
+} Emitter;
+
+static void emit8(Emitter *e, byte value) {
+  *e->out++ = value;
+}
+
+static void emit16(Emitter *e, word value) {
+  emit8(e, value & 0xFF);
+  emit8(e, (value >> 8) & 0xFF);
+}
+
+static void emit32(Emitter *e, uint value) {
+  emit16(e, value & 0xFFFF);
+  emit16(e, (value >> 16) & 0xFFFF);
+}
+
+// movzx ecx, byte [rdi + offset]
+static void emitLoadCPU(Emitter *e, byte offset) {
+  emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x4F); emit8(e, offset);
+}
+
+// movzx eax, byte [rsi + address]
+static void emitLoadAbsolute(Emitter *e, word address) {
+  emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x86); emit32(e, address);
+}
+
+// movzx eax, byte [rsi + rcx]
+static void emitLoadIndexed(Emitter *e) {
+  emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x04); emit8(e, 0x0E);
+}
+
+// Leaves the loaded value in eax, and charges the ABSX/ABSY penalty
+static void emitOperand(Emitter *e, byte mode, word operand) {
+  switch(mode) {
+    case MODE_IM:
+      emit8(e, 0xB8); emit32(e, operand); // mov eax, imm32
+      break;
+    case MODE_ZP:
+    case MODE_ABS:
+      emitLoadAbsolute(e, operand);
+      break;
+    case MODE_ZPX:
+    case MODE_ZPY:
+      emitLoadCPU(e, mode == MODE_ZPX ? offsetof(CPU, X) : offsetof(CPU, Y));
+      emit8(e, 0x80); emit8(e, 0xC1); emit8(e, operand); // add cl, imm8
+      emitLoadIndexed(e);
+      break;
+    case MODE_ABSX:
+    case MODE_ABSY:
+      emitLoadCPU(e, mode == MODE_ABSX ? offsetof(CPU, X) : offsetof(CPU, Y));
+      emit8(e, 0x81); emit8(e, 0xC1); emit32(e, operand); // add ecx, imm32
+      emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0xC9); // movzx ecx, cx
+      emitLoadIndexed(e);
+      emit8(e, 0x84); emit8(e, 0xED); // test ch, ch
+      emit8(e, 0x74); emit8(e, 0x02); // jz +2
+      emit8(e, 0xFF); emit8(e, 0x0A); // dec dword [rdx]
+      break;
+  }
+}
+
+// Stores al in the target register and records it for the lazy flags
+static void emitStore(Emitter *e, byte target) {
+  emit8(e, 0x88); emit8(e, 0x47); emit8(e, target); // mov [rdi + target], al
+  emit8(e, 0x88); emit8(e, 0x47); emit8(e, offsetof(CPU, result)); // mov [rdi + result], al
+  emit8(e, 0xC6); emit8(e, 0x47); emit8(e, offsetof(CPU, lazyFlags)); emit8(e, 1); // mov byte [rdi + lazyFlags], 1
+}
+
+// Whether every address a load can touch is in a RAM page, which the
+// generated code reads directly
+static byte readsRAM(const Memory *memory, byte mode, word operand) {
+  byte page = operand >> 8;
+  switch(mode) {
+    case MODE_IM:
+      return 1;
+    case MODE_ZP:
+    case MODE_ZPX:
+    case MODE_ZPY:
+      return isRAMPage(memory, 0);
+    case MODE_ABS:
+      return isRAMPage(memory, page);
+    default:
+      return isRAMPage(memory, page) && isRAMPage(memory, (byte)(page + 1));
+  }
+}
+
+// Translates the block starting at the block's PC. Leaves code NULL when the
+// first instruction can't be translated.
+static void translateBlock(JIT *jit, Memory *memory, JITBlock *block) {
+  if(jit->used + JIT_MAX_BLOCK_BYTES > JIT_BUFFER_SIZE) {
+    word PC = block->PC;
+    flushJIT(jit);
+    block->PC = PC;
+  }
+
+  mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE);
+
+  byte *start = jit->buffer + jit->used;
+  Emitter e = { start };
+  uint PC = block->PC;
+  uint cycles = 0;
+  uint maxCycles = 0;
+  uint count = 0;
+
+  while(count < JIT_MAX_INSTRUCTIONS && PC < MEMORY_SIZE) {
+    const jitInstruction *instruction = &jitInstructions[busRead(memory, PC)];
+    if(instruction->length == 0 || PC + instruction->length > MEMORY_SIZE)
+      break;
+    if(memory->readMap[PC >> 8] == NULL ||
+        memory->readMap[(PC + instruction->length - 1) >> 8] == NULL)
+      break;
+
+    word operand = busRead(memory, PC + 1);
+    if(instruction->length == 3)
+      operand |= busRead(memory, PC + 2) << 8;
+    if(!readsRAM(memory, instruction->mode, operand))
+      break;
+
+    emitOperand(&e, instruction->mode, operand);
+    emitStore(&e, instruction->target);
+
+    cycles += instruction->cycles;
+    maxCycles += instruction->cycles;
+    if(instruction->mode == MODE_ABSX || instruction->mode == MODE_ABSY)
+      maxCycles++;
+
+    PC += instruction->length;
+    count++;
+  }
+
+  if(count > 0) {
+    emit8(&e, 0x66); emit8(&e, 0xC7); emit8(&e, 0x47); // mov word [rdi + PC], imm16
+    emit8(&e, offsetof(CPU, PC)); emit16(&e, PC);
+    emit8(&e, 0x81); emit8(&e, 0x2A); emit32(&e, cycles); // sub dword [rdx], imm32
+    emit8(&e, 0xC3); // ret
+
+    block->code = (jitCode)start;
+    block->lastPC = PC - 1;
+    block->maxCycles = maxCycles;
+    markCode(memory, block->PC);
+    markCode(memory, block->lastPC);
+    block->generation[0] = memory->codeGeneration[block->PC >> 8];
+    block->generation[1] = memory->codeGeneration[block->lastPC >> 8];
+    jit->used += e.out - start;
+  }
+
+  mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC);
+}
+
+#endif
+
+/*
+ * Execution
+ */
+
+void executeJIT(JIT *jit, CPU *cpu, Memory *memory, uint *cycles) {
+  if(jit->buffer == NULL) {
+    execute(cpu, memory, cycles);
+    return;
+  }
+
+  while(cyclesLeft(*cycles)) {
+    if(jit->mapGeneration != memory->mapGeneration) {
+      flushJIT(jit);
+      jit->mapGeneration = memory->mapGeneration;
+    }
+
+    JITBlock *block = lookupBlock(jit, memory, cpu->PC);
+
+#ifdef JIT_NATIVE
+    if(block->code == NULL && ++block->hits >= JIT_HOT_THRESHOLD) {
+      translateBlock(jit, memory, block);
+      if(block->code == NULL)
+        block->hits = 0;
+    }
+#endif
+
+    // Blocks only run when the whole block fits the budget, the interpreter
+    // takes care of the remaining cycles.
+    if(block->code != NULL && *cycles >= block->maxCycles)
+      block->code(cpu, memory->data, cycles);
+    else
+      step(cpu, memory, cycles);
+  }
+  syncPS(cpu);
+}
@@ -0,0 +1,51 @@
+#ifndef C6502_JIT_H
+#define C6502_JIT_H
+
+#include "6502.h"
+
+/*
+ * JIT
+ *
+ * Translates hot basic blocks of 6502 code into native x86-64 code.
+ * Blocks are cached by PC in a direct-mapped table and dropped when a write
+ * hits one of the pages they were translated from. Generated code reads RAM
+ * directly, so loads that may reach ROM or device pages end the block, and
+ * any change to the memory map flushes the cache.
+ *
+ * On hosts other than x86-64 Linux, or when the code buffer cannot be
+ * allocated, executeJIT() just runs the interpreter.
+ */
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_NATIVE
+#endif
+
+#define JIT_CACHE_SIZE 4096 // Cached blocks, must be a power of two
+#define JIT_BUFFER_SIZE 1024 * 1024 // Bytes of native code
+#define JIT_MAX_INSTRUCTIONS 32 // Longest block, in 6502 instructions
+#define JIT_HOT_THRESHOLD 16 // Visits to a PC before its block is translated
+
+typedef void (*jitCode)(CPU *cpu, byte *data, uint *cycles);
+
+typedef struct {
+  jitCode code; // NULL until the block is translated
+  word PC;
+  word lastPC; // Address of the last byte of the block
+  uint generation[2]; // codeGeneration of the first and last page
+  uint maxCycles; // Most cycles the block can take
+  uint hits;
+} JITBlock;
+
+typedef struct {
+  byte *buffer;
+  uint used;
+  uint mapGeneration; // Memory map the blocks were translated against
+  JITBlock blocks[JIT_CACHE_SIZE];
+} JIT;
+
+byte initJIT(JIT *jit);
+void freeJIT(JIT *jit);
+void flushJIT(JIT *jit);
+void executeJIT(JIT *jit, CPU *cpu, Memory *memory, uint *cycles);
+
+#endif
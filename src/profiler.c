@@ -0,0 +1,122 @@
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Sampling
+ */
+
+void initProfiler(Profiler *profiler, uint period) {
+  profiler->period = period > 0 ? period : 1;
+  profiler->countdown = profiler->period;
+  memset(profiler->samples, 0, sizeof(profiler->samples));
+  profiler->total = 0;
+  initSymbols(&profiler->symbols);
+}
+
+void freeProfiler(Profiler *profiler) {
+  freeSymbols(&profiler->symbols);
+}
+
+// The countdown carries over between calls, so samples stay evenly spaced
+// however the caller splits its budget
+StopReason executeProfiled(Profiler *profiler, CPU *cpu, Memory *memory, uint *cycles) {
+  StopReason reason = STOP_BUDGET;
+  while(reason == STOP_BUDGET && cyclesLeft(*cycles)) {
+    uint slice = (uint)profiler->countdown < *cycles ? (uint)profiler->countdown : *cycles;
+    uint left = slice;
+    reason = execute(cpu, memory, &left);
+
+    // left is minus the overrun of the slice's last instruction, or what a
+    // debugger stop left of the slice
+    int ran = slice - (int)left;
+    *cycles -= ran;
+    profiler->countdown -= ran;
+    // A long instruction can take more than one period
+    while(profiler->countdown <= 0) {
+      profiler->samples[cpu->PC]++;
+      profiler->total++;
+      profiler->countdown += profiler->period;
+    }
+  }
+  return reason;
+}
+
+/*
+ * Reports
+ */
+
+typedef struct {
+  const char *name;
+  word address; // For addresses without a symbol
+  uint samples;
+} ProfileEntry;
+
+static int compareEntries(const void *a, const void *b) {
+  const ProfileEntry *x = a, *y = b;
+  if(x->samples != y->samples)
+    return x->samples < y->samples ? 1 : -1;
+  return (int)x->address - (int)y->address;
+}
+
+// Sums the samples per symbol, or per address outside any symbol. Returns
+// the number of entries, sorted by most samples first.
+static uint collectEntries(const Profiler *profiler, ProfileEntry *entries) {
+  uint count = 0;
+
+  for(uint address = 0; address < MEMORY_SIZE; address++) {
+    if(profiler->samples[address] == 0)
+      continue;
+
+    // Addresses go up, so the addresses of a symbol come one after another
+    const char *name = findSymbol(&profiler->symbols, address);
+    ProfileEntry *entry = count > 0 ? &entries[count - 1] : NULL;
+    if(entry == NULL || name == NULL || entry->name != name) {
+      entry = &entries[count++];
+      entry->name = name;
+      entry->address = address;
+      entry->samples = 0;
+    }
+    entry->samples += profiler->samples[address];
+  }
+
+  qsort(entries, count, sizeof(ProfileEntry), compareEntries);
+  return count;
+}
+
+static void writeName(const ProfileEntry *entry, FILE *out) {
+  if(entry->name != NULL)
+    fprintf(out, "%s", entry->name);
+  else
+    fprintf(out, "$%04X", entry->address);
+}
+
+void writeFlatProfile(const Profiler *profiler, FILE *out) {
+  ProfileEntry *entries = malloc(MEMORY_SIZE * sizeof(ProfileEntry));
+  if(entries == NULL)
+    return;
+  uint count = collectEntries(profiler, entries);
+
+  fprintf(out, "%10s %8s  %s\n", "samples", "percent", "symbol");
+  for(uint i = 0; i < count; i++) {
+    fprintf(out, "%10u %7.2f%%  ", entries[i].samples,
+      entries[i].samples * 100.0 / profiler->total);
+    writeName(&entries[i], out);
+    fprintf(out, "\n");
+  }
+  free(entries);
+}
+
+// One "frame count" line per symbol, the format flamegraph.pl reads
+void writeFoldedStacks(const Profiler *profiler, FILE *out) {
+  ProfileEntry *entries = malloc(MEMORY_SIZE * sizeof(ProfileEntry));
+  if(entries == NULL)
+    return;
+  uint count = collectEntries(profiler, entries);
+
+  for(uint i = 0; i < count; i++) {
+    writeName(&entries[i], out);
+    fprintf(out, " %u\n", entries[i].samples);
+  }
+  free(entries);
+}
@@ -0,0 +1,33 @@
+#ifndef C6502_PROFILER_H
+#define C6502_PROFILER_H
+
+#include <stdio.h>
+#include "6502.h"
+#include "symbols.h"
+
+/*
+ * PROFILER
+ *
+ * Samples the PC every period cycles. executeProfiled() runs execute() in
+ * slices that end on the next sample, so the interpreter runs at full speed
+ * in between. Samples are counted per address, and reported per symbol once
+ * symbols are loaded into it.
+ */
+
+typedef struct {
+  uint period; // Cycles between samples
+  int countdown; // Cycles until the next sample
+  uint samples[MEMORY_SIZE]; // Samples per PC
+  uint total;
+  SymbolTable symbols; // Names the samples in reports
+} Profiler;
+
+void initProfiler(Profiler *profiler, uint period);
+void freeProfiler(Profiler *profiler);
+// Returns early, like execute(), when an attached debugger stops the run
+StopReason executeProfiled(Profiler *profiler, CPU *cpu, Memory *memory, uint *cycles);
+
+void writeFlatProfile(const Profiler *profiler, FILE *out);
+void writeFoldedStacks(const Profiler *profiler, FILE *out);
+
+#endif
@@ -0,0 +1,158 @@
+#include "scheduler.h"
+#include <stddef.h>
+
+void initScheduler(Scheduler *scheduler) {
+  scheduler->clock = 0;
+  scheduler->sequence = 0;
+  scheduler->count = 0;
+}
+
+/*
+ * Event queue
+ */
+
+static byte isBefore(const Event *a, const Event *b) {
+  if(a->deadline != b->deadline)
+    return a->deadline < b->deadline;
+  return a->sequence < b->sequence;
+}
+
+static void swapEvents(Scheduler *scheduler, uint a, uint b) {
+  Event event = scheduler->events[a];
+  scheduler->events[a] = scheduler->events[b];
+  scheduler->events[b] = event;
+}
+
+static void siftUp(Scheduler *scheduler, uint i) {
+  while(i > 0 && isBefore(&scheduler->events[i], &scheduler->events[(i - 1) / 2])) {
+    swapEvents(scheduler, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void siftDown(Scheduler *scheduler, uint i) {
+  for(;;) {
+    uint first = i;
+    for(uint child = 2 * i + 1; child <= 2 * i + 2 && child < scheduler->count; child++) {
+      if(isBefore(&scheduler->events[child], &scheduler->events[first]))
+        first = child;
+    }
+    if(first == i)
+      return;
+    swapEvents(scheduler, i, first);
+    i = first;
+  }
+}
+
+static void removeEvent(Scheduler *scheduler, uint i) {
+  scheduler->events[i] = scheduler->events[--scheduler->count];
+  if(i < scheduler->count) {
+    siftUp(scheduler, i);
+    siftDown(scheduler, i);
+  }
+}
+
+byte scheduleEvent(Scheduler *scheduler, uint64_t deadline, EventHandler handler, void *context) {
+  if(scheduler->count == SCHEDULER_MAX_EVENTS)
+    return 0;
+
+  Event *event = &scheduler->events[scheduler->count];
+  event->deadline = deadline;
+  event->sequence = scheduler->sequence++;
+  event->handler = handler;
+  event->context = context;
+  siftUp(scheduler, scheduler->count++);
+  return 1;
+}
+
+byte cancelEvent(Scheduler *scheduler, EventHandler handler, void *context) {
+  int found = -1;
+  for(uint i = 0; i < scheduler->count; i++) {
+    const Event *event = &scheduler->events[i];
+    if(event->handler == handler && event->context == context &&
+        (found < 0 || isBefore(event, &scheduler->events[found])))
+      found = i;
+  }
+  if(found < 0)
+    return 0;
+  removeEvent(scheduler, found);
+  return 1;
+}
+
+uint64_t nextDeadline(const Scheduler *scheduler) {
+  return scheduler->count > 0 ? scheduler->events[0].deadline : UINT64_MAX;
+}
+
+/*
+ * Running
+ */
+
+StopReason runScheduled(Scheduler *scheduler, Machine *machine, uint64_t cycles) {
+  uint64_t end = scheduler->clock + cycles;
+
+  while(scheduler->clock < end) {
+    uint64_t stop = nextDeadline(scheduler) < end ? nextDeadline(scheduler) : end;
+    StopReason reason = runUntil(machine, &scheduler->clock, stop).stop;
+
+    // Handlers may schedule more events, even ones already due
+    while(scheduler->count > 0 && scheduler->events[0].deadline <= scheduler->clock) {
+      Event event = scheduler->events[0];
+      removeEvent(scheduler, 0);
+      event.handler(scheduler, event.context);
+    }
+    if(reason != STOP_BUDGET)
+      return reason;
+  }
+  return STOP_BUDGET;
+}
+
+/*
+ * Idle loops
+ */
+
+static byte sameState(const CPU *a, const CPU *b) {
+  return a->PC == b->PC && a->SP == b->SP && a->A == b->A &&
+    a->X == b->X && a->Y == b->Y && a->PS == b->PS;
+}
+
+// Runs single instructions until the CPU state comes back, then skips whole
+// turns of the loop up to the next deadline
+uint64_t skipIdle(Scheduler *scheduler, Machine *machine, uint probe) {
+  CPU *cpu = &machine->cpu;
+  Memory *memory = &machine->memory;
+  uint64_t stop = nextDeadline(scheduler);
+  if(stop == UINT64_MAX || stop <= scheduler->clock)
+    return 0;
+  // Single instructions would step past breakpoints
+  if(memory->debugger)
+    return 0;
+#ifdef EXECUTION_TRACE
+  if(memory->tracer)
+    return 0;
+#endif
+
+  syncPS(cpu);
+  CPU start = *cpu;
+  uint64_t period = 0;
+  byte found = 0;
+
+  for(uint i = 0; i < probe && scheduler->clock + period < stop; i++) {
+    // Opcodes aren't peeked from devices, reading them may have effects
+    if(memory->readMap[cpu->PC >> 8] == NULL || opcodeStores[busRead(memory, cpu->PC)])
+      break;
+    uint budget = 1;
+    execute(cpu, memory, &budget);
+    period += 1 - (int)budget;
+    if(sameState(cpu, &start)) {
+      found = 1;
+      break;
+    }
+  }
+
+  scheduler->clock += period;
+  if(!found || scheduler->clock >= stop)
+    return 0;
+  uint64_t skipped = (stop - scheduler->clock) / period * period;
+  scheduler->clock += skipped;
+  return skipped;
+}
@@ -0,0 +1,70 @@
+#ifndef C6502_SCHEDULER_H
+#define C6502_SCHEDULER_H
+
+#include <stdint.h>
+#include "6502.h"
+
+/*
+ * EVENT SCHEDULER
+ *
+ * Keeps the master clock, a 64-bit count of the cycles a machine has run,
+ * and a queue of events due at future clock values. runScheduled() runs
+ * the machine with runUntil() straight to the next deadline, so
+ * nothing is checked between instructions. Devices, timers and interrupt
+ * sources schedule events instead of being polled.
+ *
+ * Events run at the first instruction boundary at or past their deadline,
+ * so clock may be a few cycles ahead of it when the handler runs. Events
+ * due on the same cycle run in the order they were scheduled.
+ *
+ * skipIdle() is a hook for callers that know the guest is waiting for an
+ * event. It steps up to probe instructions looking for an idle loop: the
+ * whole CPU state coming back with no store in between. Such a loop can
+ * only change when an event does, so whole turns of it are skipped up to
+ * the next deadline, and their cycles charged to the clock. Device reads
+ * are taken to return the same values between events. Skipped turns aren't
+ * traced or counted by the statistics, and nothing is skipped while a
+ * tracer or a debugger is attached. runScheduled() never calls it: without
+ * branches, the only loop a program can make is the PC wrapping around
+ * memory.
+ */
+
+#define SCHEDULER_MAX_EVENTS 64
+
+struct Scheduler;
+typedef void (*EventHandler)(struct Scheduler *scheduler, void *context);
+
+typedef struct {
+  uint64_t deadline;
+  uint64_t sequence; // Scheduling order, breaks ties between deadlines
+  EventHandler handler;
+  void *context;
+} Event;
+
+typedef struct Scheduler {
+  uint64_t clock;
+  uint64_t sequence;
+  Event events[SCHEDULER_MAX_EVENTS]; // Binary heap, earliest deadline first
+  uint count;
+} Scheduler;
+
+void initScheduler(Scheduler *scheduler);
+// Returns 0 when the queue is full
+byte scheduleEvent(Scheduler *scheduler, uint64_t deadline, EventHandler handler, void *context);
+// Removes the earliest event with this handler and context, returns 0 if
+// there was none
+byte cancelEvent(Scheduler *scheduler, EventHandler handler, void *context);
+// UINT64_MAX when nothing is scheduled
+uint64_t nextDeadline(const Scheduler *scheduler);
+
+// Runs the machine for the given cycles, plus the overrun of the last
+// instruction, running events as their deadlines pass. Returns early when
+// a debugger stops execute(), after running the events that are due.
+StopReason runScheduled(Scheduler *scheduler, Machine *machine, uint64_t cycles);
+
+// Returns the cycles skipped, 0 when there is no deadline to skip to or no
+// idle loop within probe instructions. The instructions probed run either
+// way, and are charged to the clock.
+uint64_t skipIdle(Scheduler *scheduler, Machine *machine, uint probe);
+
+#endif
@@ -0,0 +1,37 @@
+#include "snapshot.h"
+#include <string.h>
+
+// Takes a full copy. Writes from here on carry the snapshot's stamp or a
+// later one.
+void takeSnapshot(Snapshot *snapshot, Machine *machine) {
+  Memory *memory = &machine->memory;
+
+  snapshot->cpu = machine->cpu;
+  memcpy(snapshot->data, memory->data, sizeof(snapshot->data));
+  snapshot->stamp = ++memory->writeStamp;
+}
+
+byte pageWritten(const Snapshot *snapshot, const Machine *machine, byte page) {
+  return machine->memory.pageStamps[page] >= snapshot->stamp;
+}
+
+// Copies back the pages written since the snapshot was taken
+void restoreSnapshot(const Snapshot *snapshot, Machine *machine) {
+  Memory *memory = &machine->memory;
+
+  // Restored pages differ from any newer snapshot, so they are stamped as
+  // written for all of them. When there is none they are clean again.
+  uint64_t stamp = snapshot->stamp == memory->writeStamp ?
+    snapshot->stamp - 1 : memory->writeStamp;
+
+  machine->cpu = snapshot->cpu;
+  for(uint page = 0; page < MEMORY_PAGES; page++) {
+    if(!pageWritten(snapshot, machine, page))
+      continue;
+
+    memcpy(&memory->data[page << 8], &snapshot->data[page << 8], MEMORY_PAGE_SIZE);
+    memory->pageStamps[page] = stamp;
+    if(memory->codePages[page])
+      invalidateCode(memory, page << 8);
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef C6502_SNAPSHOT_H
+#define C6502_SNAPSHOT_H
+
+#include "6502.h"
+
+/*
+ * SNAPSHOT
+ *
+ * Saves the CPU and RAM of a machine, and restores them later by copying
+ * back only the 256-byte pages written since the snapshot was taken. Pages
+ * are tracked by the bus, so memory must only be written through it
+ * (writeByte, or the CPU) between a snapshot and its restores. Device
+ * state is not part of a snapshot.
+ *
+ * Each snapshot has a stamp, and the bus stamps every page it writes with
+ * the latest one, so a machine can keep any number of snapshots and restore
+ * them in any order. initMemory() starts the stamps over, which leaves the
+ * snapshots taken before it unusable.
+ */
+
+typedef struct {
+  CPU cpu;
+  byte data[MEMORY_SIZE];
+  uint64_t stamp;
+} Snapshot;
+
+void takeSnapshot(Snapshot *snapshot, Machine *machine);
+void restoreSnapshot(const Snapshot *snapshot, Machine *machine);
+
+// Whether the page was written since the snapshot, so restoring copies it
+byte pageWritten(const Snapshot *snapshot, const Machine *machine, byte page);
+
+#endif
@@ -0,0 +1,140 @@
+#include "stats.h"
+
+#ifdef OPCODE_STATS
+
+#include <stdlib.h>
+#include <string.h>
+
+OpcodeCounter opcodeStats[256];
+uint64_t opcodePairs[256][256];
+
+#define STATS_NAME(name, mode, reg) [OP_##name] = #name,
+#define STATS_MODE(name, mode, reg) [OP_##name] = MODE_##mode + 1,
+
+static const char * const opcodeNames[256] = {
+  INSTRUCTIONS(STATS_NAME)
+  [OP_JSR] = "JSR",
+  [OP_RTS] = "RTS",
+};
+
+// Addressing mode of each load opcode plus one, 0 for any other opcode
+static const byte opcodeModes[256] = {
+  INSTRUCTIONS(STATS_MODE)
+};
+
+static const char * const modeNames[ADDRESSING_MODES] = {
+  "IM", "ZP", "ZPX", "ZPY", "ABS", "ABSX", "ABSY"
+};
+
+void resetOpcodeStats() {
+  memset(opcodeStats, 0, sizeof(opcodeStats));
+  memset(opcodePairs, 0, sizeof(opcodePairs));
+}
+
+void getModeStats(OpcodeCounter modes[ADDRESSING_MODES]) {
+  memset(modes, 0, ADDRESSING_MODES * sizeof(OpcodeCounter));
+  for(int opcode = 0; opcode < 256; opcode++) {
+    if(opcodeModes[opcode] == 0)
+      continue;
+
+    OpcodeCounter *mode = &modes[opcodeModes[opcode] - 1];
+    mode->count += opcodeStats[opcode].count;
+    mode->cycles += opcodeStats[opcode].cycles;
+    mode->ticks += opcodeStats[opcode].ticks;
+  }
+}
+
+/*
+ * Report
+ */
+
+typedef struct {
+  const char *name;
+  int opcode; // -1 for addressing modes
+  const OpcodeCounter *counter;
+} ReportRow;
+
+// Most host time first, then most executions
+static int compareRows(const void *a, const void *b) {
+  const OpcodeCounter *x = ((const ReportRow *)a)->counter;
+  const OpcodeCounter *y = ((const ReportRow *)b)->counter;
+  if(x->ticks != y->ticks)
+    return x->ticks < y->ticks ? 1 : -1;
+  if(x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+  return 0;
+}
+
+static void printRows(FILE *out, const char *title, ReportRow *rows, int count) {
+  fprintf(out, "%-10s %4s %14s %14s %16s %10s\n", title, "", "count", "cycles", "ticks", "ticks/op");
+  qsort(rows, count, sizeof(ReportRow), compareRows);
+  for(int i = 0; i < count; i++) {
+    const OpcodeCounter *counter = rows[i].counter;
+    fprintf(out, "%-10s ", rows[i].name);
+    if(rows[i].opcode >= 0)
+      fprintf(out, "$%02X ", rows[i].opcode);
+    else
+      fprintf(out, "%4s", "");
+    fprintf(out, "%14llu %14llu %16llu %10.1f\n",
+      (unsigned long long)counter->count,
+      (unsigned long long)counter->cycles,
+      (unsigned long long)counter->ticks,
+      (double)counter->ticks / counter->count);
+  }
+}
+
+// Prints opcodes, then addressing modes, by most host time first
+void printOpcodeStats(FILE *out) {
+  ReportRow rows[256];
+  int count = 0;
+
+  for(int opcode = 0; opcode < 256; opcode++) {
+    if(opcodeStats[opcode].count == 0)
+      continue;
+
+    const char *name = opcodeNames[opcode] != NULL ? opcodeNames[opcode] : "???";
+    rows[count++] = (ReportRow){ name, opcode, &opcodeStats[opcode] };
+  }
+  printRows(out, "opcode", rows, count);
+
+  OpcodeCounter modes[ADDRESSING_MODES];
+  getModeStats(modes);
+  count = 0;
+  for(int mode = 0; mode < ADDRESSING_MODES; mode++) {
+    if(modes[mode].count > 0)
+      rows[count++] = (ReportRow){ modeNames[mode], -1, &modes[mode] };
+  }
+  fprintf(out, "\n");
+  printRows(out, "mode", rows, count);
+}
+
+#endif
+
+/*
+ * Pair profiles
+ */
+
+byte writeOpcodePairs(uint64_t pairs[256][256], FILE *file) {
+  for(int first = 0; first < 256; first++) {
+    for(int second = 0; second < 256; second++) {
+      if(pairs[first][second] > 0 &&
+          fprintf(file, "%02X %02X %llu\n", first, second,
+            (unsigned long long)pairs[first][second]) < 0)
+        return 0;
+    }
+  }
+  return fflush(file) == 0;
+}
+
+byte readOpcodePairs(uint64_t pairs[256][256], FILE *file) {
+  unsigned int first, second;
+  unsigned long long count;
+  int read;
+
+  while((read = fscanf(file, "%x %x %llu", &first, &second, &count)) == 3) {
+    if(first > 0xFF || second > 0xFF)
+      return 0;
+    pairs[first][second] += count;
+  }
+  return read == EOF && !ferror(file);
+}
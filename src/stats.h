@@ -0,0 +1,56 @@
+#ifndef C6502_STATS_H
+#define C6502_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "6502.h"
+
+/*
+ * OPCODE STATISTICS
+ *
+ * With -DOPCODE_STATS, execute() counts every instruction it runs in
+ * opcodeStats: executions, emulated cycles including the opcode fetch, and
+ * host time stamp counter ticks (x86 only, 0 elsewhere). Per addressing
+ * mode figures are the sums over the opcodes using each ADDR_* helper.
+ * opcodePairs counts how often each opcode follows another within one
+ * execute() call, the profile the superinstructions are chosen from (see
+ * superinstructions.h).
+ *
+ * The counters are shared by all threads, so profile one machine at a time.
+ * Without the option none of this is compiled, and execute() is unchanged.
+ */
+
+#define ADDRESSING_MODES (MODE_ABSY + 1)
+
+typedef struct {
+  uint64_t count;
+  uint64_t cycles;
+  uint64_t ticks;
+} OpcodeCounter;
+
+#ifdef OPCODE_STATS
+
+extern OpcodeCounter opcodeStats[256];
+extern uint64_t opcodePairs[256][256]; // [first][second]
+
+static inline uint64_t readTicks() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+void resetOpcodeStats();
+void getModeStats(OpcodeCounter modes[ADDRESSING_MODES]);
+void printOpcodeStats(FILE *out);
+
+#endif
+
+// Pair profiles are text, one "first second count" line per pair seen, with
+// the opcodes in hex. Reading adds to the counts, so profiles can be merged.
+// Both return 0 on an I/O error or a bad line.
+byte writeOpcodePairs(uint64_t pairs[256][256], FILE *file);
+byte readOpcodePairs(uint64_t pairs[256][256], FILE *file);
+
+#endif
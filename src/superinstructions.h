@@ -0,0 +1,16 @@
+#ifndef C6502_SUPERINSTRUCTIONS_H
+#define C6502_SUPERINSTRUCTIONS_H
+
+/*
+ * SUPERINSTRUCTIONS
+ *
+ * Generated by tools/superinstructions.c from opcode pair profiles, run
+ * make superinstructions instead of editing it.
+ *
+ * The pairs the decode cache fuses into one handler. Empty until it is
+ * generated from pair profiles of real programs.
+ */
+
+#define SUPERINSTRUCTIONS(SUPERINSTRUCTION)
+
+#endif
@@ -0,0 +1,113 @@
+#include "symbols.h"
+#include <stdlib.h>
+#include <string.h>
+
+void initSymbols(SymbolTable *table) {
+  table->symbols = NULL;
+  table->count = 0;
+}
+
+void freeSymbols(SymbolTable *table) {
+  for(uint i = 0; i < table->count; i++) {
+    free(table->symbols[i].name);
+  }
+  free(table->symbols);
+  initSymbols(table);
+}
+
+static int compareSymbols(const void *a, const void *b) {
+  return (int)((const Symbol *)a)->address - (int)((const Symbol *)b)->address;
+}
+
+static byte addSymbol(SymbolTable *table, word address, const char *name) {
+  Symbol *symbols = realloc(table->symbols, (table->count + 1) * sizeof(Symbol));
+  if(symbols == NULL)
+    return 0;
+  table->symbols = symbols;
+
+  char *copy = malloc(strlen(name) + 1);
+  if(copy == NULL)
+    return 0;
+  strcpy(copy, name);
+
+  symbols[table->count].address = address;
+  symbols[table->count].name = copy;
+  table->count++;
+  return 1;
+}
+
+static void sortSymbols(SymbolTable *table) {
+  qsort(table->symbols, table->count, sizeof(Symbol), compareSymbols);
+}
+
+// VICE label lists hold one "al C:1234 .name" per line, the C: is optional
+int loadVICELabels(SymbolTable *table, FILE *file) {
+  char line[256], name[128];
+  uint address;
+  int count = 0;
+
+  while(fgets(line, sizeof(line), file) != NULL) {
+    if(sscanf(line, "al C:%x .%127s", &address, name) != 2 &&
+        sscanf(line, "al %x .%127s", &address, name) != 2)
+      continue;
+    if(!addSymbol(table, address, name))
+      return -1;
+    count++;
+  }
+  sortSymbols(table);
+  return count;
+}
+
+// ld65 --dbgfile output: labels are the "sym" lines with type=lab, e.g.
+// sym id=0,name="main",addrsize=absolute,scope=0,def=1,val=0x8000,seg=0,type=lab
+int loadCA65Symbols(SymbolTable *table, FILE *file) {
+  char line[512], name[128];
+  uint address;
+  int count = 0;
+
+  while(fgets(line, sizeof(line), file) != NULL) {
+    if(strncmp(line, "sym\t", 4) != 0 || strstr(line, "type=lab") == NULL)
+      continue;
+
+    const char *nameField = strstr(line, "name=\"");
+    const char *valueField = strstr(line, "val=0x");
+    if(nameField == NULL || valueField == NULL ||
+        sscanf(nameField, "name=\"%127[^\"]\"", name) != 1 ||
+        sscanf(valueField, "val=0x%x", &address) != 1)
+      continue;
+    if(!addSymbol(table, address, name))
+      return -1;
+    count++;
+  }
+  sortSymbols(table);
+  return count;
+}
+
+// Index of the last symbol at or below the address, -1 when there is none
+static int searchSymbols(const SymbolTable *table, word address) {
+  int low = 0, high = (int)table->count - 1;
+  int found = -1;
+
+  while(low <= high) {
+    int middle = (low + high) / 2;
+    if(table->symbols[middle].address <= address) {
+      found = middle;
+      low = middle + 1;
+    } else {
+      high = middle - 1;
+    }
+  }
+  return found;
+}
+
+const char *findSymbol(const SymbolTable *table, word address) {
+  int index = searchSymbols(table, address);
+  return index >= 0 ? table->symbols[index].name : NULL;
+}
+
+const char *symbolAt(const SymbolTable *table, word address) {
+  int index = searchSymbols(table, address);
+  if(index < 0 || table->symbols[index].address != address)
+    return NULL;
+  return table->symbols[index].name;
+}
@@ -0,0 +1,37 @@
+#ifndef C6502_SYMBOLS_H
+#define C6502_SYMBOLS_H
+
+#include <stdio.h>
+#include "6502.h"
+
+/*
+ * SYMBOLS
+ *
+ * Guest labels, read from a VICE label list or a ca65/ld65 debug file, for
+ * the profilers to name addresses with.
+ */
+
+typedef struct {
+  word address;
+  char *name;
+} Symbol;
+
+typedef struct {
+  Symbol *symbols; // Sorted by address
+  uint count;
+} SymbolTable;
+
+void initSymbols(SymbolTable *table);
+void freeSymbols(SymbolTable *table);
+
+// Both return the number of symbols read, or -1 on allocation failure
+int loadVICELabels(SymbolTable *table, FILE *file);
+int loadCA65Symbols(SymbolTable *table, FILE *file);
+
+// Nearest symbol at or below the address, NULL when there is none
+const char *findSymbol(const SymbolTable *table, word address);
+
+// Symbol at exactly the address, NULL when there is none
+const char *symbolAt(const SymbolTable *table, word address);
+
+#endif
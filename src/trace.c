@@ -0,0 +1,300 @@
+#define _DEFAULT_SOURCE // nanosleep
+
+#include "trace.h"
+#include <time.h>
+
+#define TRACE_LENGTH(name, mode, reg) [OP_##name] = LENGTH_##mode,
+#define TRACE_NAME(name, mode, reg) [OP_##name] = #name,
+
+// Bytes of each load opcode, 0 for opcodes whose next PC is always recorded
+const byte traceLengths[256] = {
+  INSTRUCTIONS(TRACE_LENGTH)
+};
+
+static const char * const traceNames[256] = {
+  INSTRUCTIONS(TRACE_NAME)
+  [OP_JSR] = "JSR",
+  [OP_RTS] = "RTS",
+};
+
+static void pause() {
+  struct timespec delay = { 0, 100000 };
+  nanosleep(&delay, NULL);
+}
+
+/*
+ * Writer thread
+ */
+
+static void *drain(void *argument) {
+  Tracer *tracer = argument;
+
+  for(;;) {
+    // stop is read first: once it is set, head holds every record
+    int stop = __atomic_load_n(&tracer->stop, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&tracer->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = tracer->tail;
+
+    if(head == tail) {
+      if(stop)
+        break;
+      pause();
+      continue;
+    }
+
+    // Up to the end of the ring, the rest goes on the next round
+    uint64_t start = tail & (TRACE_RING_SIZE - 1);
+    uint64_t length = head - tail;
+    if(start + length > TRACE_RING_SIZE)
+      length = TRACE_RING_SIZE - start;
+    if(fwrite(tracer->ring + start, 1, length, tracer->file) != length)
+      tracer->failed = 1;
+    __atomic_store_n(&tracer->tail, tail + length, __ATOMIC_RELEASE);
+  }
+
+  if(fflush(tracer->file) != 0)
+    tracer->failed = 1;
+  return NULL;
+}
+
+byte startTrace(Tracer *tracer, FILE *file) {
+  tracer->head = tracer->tail = 0;
+  tracer->limit = TRACE_RING_SIZE;
+  tracer->stop = 0;
+  tracer->file = file;
+  tracer->failed = 0;
+  tracer->A = tracer->X = tracer->Y = tracer->SP = tracer->PS = 0;
+  tracer->lastAddress = tracer->address = 0;
+  tracer->accessed = 0;
+  tracer->records = 0;
+
+  if(fwrite(TRACE_MAGIC, TRACE_HEADER_SIZE, 1, file) != 1)
+    return 0;
+  return pthread_create(&tracer->thread, NULL, drain, tracer) == 0;
+}
+
+byte stopTrace(Tracer *tracer) {
+  __atomic_store_n(&tracer->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(tracer->thread, NULL);
+  return !tracer->failed;
+}
+
+#ifdef EXECUTION_TRACE
+void attachTracer(Memory *memory, Tracer *tracer) {
+  memory->tracer = tracer;
+}
+#endif
+
+/*
+ * Recording
+ */
+
+// Waits for the writer thread to make room for a record
+void traceWait(Tracer *tracer) {
+  for(;;) {
+    tracer->limit = __atomic_load_n(&tracer->tail, __ATOMIC_ACQUIRE) + TRACE_RING_SIZE;
+    if(tracer->head + TRACE_MAX_RECORD <= tracer->limit)
+      return;
+    pause();
+  }
+}
+
+void traceSync(Tracer *tracer, const CPU *cpu) {
+  if(tracer->head + TRACE_MAX_RECORD > tracer->limit)
+    traceWait(tracer);
+
+  byte *record = tracer->ring + (tracer->head & (TRACE_RING_SIZE - 1));
+  record[0] = TRACE_SYNC;
+  record[1] = cpu->PC & 0xFF;
+  record[2] = cpu->PC >> 8;
+  record[3] = tracer->A = cpu->A;
+  record[4] = tracer->X = cpu->X;
+  record[5] = tracer->Y = cpu->Y;
+  record[6] = tracer->SP = cpu->SP;
+  record[7] = tracer->PS = tracePS(cpu);
+  traceCommit(tracer, 8);
+  tracer->accessed = 0;
+}
+
+/*
+ * Reading
+ */
+
+#define TRACE_CYCLES(name, mode, reg) [OP_##name] = CYCLES_##mode,
+#define TRACE_INDEXED(name, mode, reg) [OP_##name] = TRACE_INDEXED_##mode,
+
+#define TRACE_INDEXED_IM   0
+#define TRACE_INDEXED_ZP   0
+#define TRACE_INDEXED_ZPX  0
+#define TRACE_INDEXED_ZPY  0
+#define TRACE_INDEXED_ABS  0
+#define TRACE_INDEXED_ABSX 1
+#define TRACE_INDEXED_ABSY 1
+
+// Cycles are rebuilt from the opcode, plus the penalty execute() charges
+// indexed absolute loads that end outside page zero
+static const byte traceCycles[256] = {
+  INSTRUCTIONS(TRACE_CYCLES)
+  [OP_JSR] = 6,
+  [OP_RTS] = 6,
+};
+
+static const byte traceIndexed[256] = {
+  INSTRUCTIONS(TRACE_INDEXED)
+};
+
+void initTraceState(TraceState *state) {
+  memset(state, 0, sizeof(TraceState));
+}
+
+// Reads a zigzag varint of at most 3 bytes, returns its length or 0
+static size_t readVarint(const byte *data, size_t size, int *delta) {
+  uint value = 0;
+  for(size_t i = 0; i < size && i < 3; i++) {
+    value |= (uint)(data[i] & 0x7F) << (7 * i);
+    if(!(data[i] & 0x80)) {
+      *delta = (int)(value >> 1) ^ -(int)(value & 1);
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+size_t readTraceRecord(TraceState *state, const byte *data, size_t size) {
+  if(size < 2)
+    return 0;
+
+  byte tag = data[0];
+  if(tag & TRACE_SYNC) {
+    if(size < 8)
+      return 0;
+    state->tag = tag;
+    state->PC = state->cpu.PC = data[1] | (data[2] << 8);
+    state->cpu.A = data[3];
+    state->cpu.X = data[4];
+    state->cpu.Y = data[5];
+    state->cpu.SP = data[6];
+    state->cpu.PS = data[7];
+    return 8;
+  }
+
+  // Registers are only committed once the whole record is there
+  byte registers[5] = {
+    state->cpu.A, state->cpu.X, state->cpu.Y, state->cpu.SP, state->cpu.PS
+  };
+  size_t length = 2;
+  for(int i = 0; i < 5; i++) {
+    if(tag & (1 << i)) {
+      if(length >= size)
+        return 0;
+      registers[i] = data[length++];
+    }
+  }
+
+  int delta;
+  size_t read;
+  word address = state->address;
+  if(tag & TRACE_ADDRESS) {
+    if(!(read = readVarint(data + length, size - length, &delta)))
+      return 0;
+    address += delta;
+    length += read;
+  }
+  word PC = state->cpu.PC;
+  word next = PC + traceLengths[data[1]];
+  if(tag & TRACE_JUMP) {
+    if(!(read = readVarint(data + length, size - length, &delta)))
+      return 0;
+    next = PC + delta;
+    length += read;
+  }
+
+  state->tag = tag;
+  state->opcode = data[1];
+  state->PC = PC;
+  state->cpu.PC = next;
+  state->cpu.A = registers[0];
+  state->cpu.X = registers[1];
+  state->cpu.Y = registers[2];
+  state->cpu.SP = registers[3];
+  state->cpu.PS = registers[4];
+  state->address = address;
+  state->cycles += traceCycles[state->opcode];
+  if(traceIndexed[state->opcode] && (address >> 8) != 0x00)
+    state->cycles++;
+  state->records++;
+  return length;
+}
+
+byte traceAddresses(const TraceState *state, word addresses[2]) {
+  if(!(state->tag & TRACE_ADDRESS) || (state->tag & TRACE_SYNC))
+    return 0;
+
+  // The stack wraps around page one: JSR's last push is below the return
+  // address high byte, RTS's last pull above the low byte
+  word page = state->address & 0xFF00;
+  addresses[0] = state->address;
+  switch(state->opcode) {
+    case OP_JSR:
+      addresses[1] = page | ((state->address + 1) & 0xFF);
+      return 2;
+    case OP_RTS:
+      addresses[1] = page | ((state->address - 1) & 0xFF);
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+/*
+ * Decoding
+ */
+
+#define TRACE_BUFFER_SIZE 65536
+
+void writeTraceRecord(FILE *out, const TraceState *state) {
+  const CPU *cpu = &state->cpu;
+  if(state->tag & TRACE_SYNC) {
+    fprintf(out, "---- sync PC=%04X A=%02X X=%02X Y=%02X SP=%02X PS=%02X\n",
+      cpu->PC, cpu->A, cpu->X, cpu->Y, cpu->SP, cpu->PS);
+    return;
+  }
+
+  const char *name = traceNames[state->opcode];
+  fprintf(out, "%04X  %02X %-8s A=%02X X=%02X Y=%02X SP=%02X PS=%02X",
+    state->PC, state->opcode, name ? name : "???",
+    cpu->A, cpu->X, cpu->Y, cpu->SP, cpu->PS);
+  if(state->tag & TRACE_ADDRESS)
+    fprintf(out, "  [%04X]", state->address);
+  fprintf(out, "\n");
+}
+
+byte decodeTrace(FILE *in, FILE *out) {
+  byte buffer[TRACE_BUFFER_SIZE];
+
+  if(fread(buffer, TRACE_HEADER_SIZE, 1, in) != 1 ||
+      memcmp(buffer, TRACE_MAGIC, TRACE_HEADER_SIZE) != 0)
+    return 0;
+
+  TraceState state;
+  initTraceState(&state);
+  size_t used = 0, offset = 0;
+
+  for(;;) {
+    // Keeps at least a whole record in the buffer until the end of the file
+    if(used - offset < TRACE_MAX_RECORD) {
+      memmove(buffer, buffer + offset, used - offset);
+      used -= offset;
+      offset = 0;
+      used += fread(buffer + used, 1, TRACE_BUFFER_SIZE - used, in);
+      if(used == 0)
+        return 1;
+    }
+
+    size_t length = readTraceRecord(&state, buffer + offset, used - offset);
+    if(length == 0)
+      return 0;
+    offset += length;
+    writeTraceRecord(out, &state);
+  }
+}
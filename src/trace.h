@@ -0,0 +1,195 @@
+#ifndef C6502_TRACE_H
+#define C6502_TRACE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "6502.h"
+
+/*
+ * EXECUTION TRACE
+ *
+ * With -DEXECUTION_TRACE, execute() writes one binary record per instruction
+ * to the Tracer attached to its Memory. Records go into a single producer,
+ * single consumer ring buffer, and a writer thread drains it to the file.
+ * The interpreter only blocks when the ring is full. step(), the decode
+ * cache, the JIT and the batch interpreter aren't traced.
+ *
+ * The file starts with "C6502TR1". Each record starts with a tag byte:
+ *
+ *   TRACE_SYNC   Full state: PC (little-endian), A, X, Y, SP, PS. Written
+ *                when execute() starts, the following PCs follow from it.
+ *   otherwise    The opcode, the new value of each register whose TRACE_*
+ *                bit is set, in A, X, Y, SP, PS order, then the varints.
+ *
+ * TRACE_ADDRESS adds the last data address the instruction read or wrote,
+ * as a varint of its zigzag delta from the previous one. TRACE_JUMP adds the
+ * zigzag delta from the instruction's PC to the next PC, for instructions
+ * that don't just move past their own bytes.
+ */
+
+#define TRACE_A       0x01
+#define TRACE_X       0x02
+#define TRACE_Y       0x04
+#define TRACE_SP      0x08
+#define TRACE_PS      0x10
+#define TRACE_ADDRESS 0x20
+#define TRACE_JUMP    0x40
+#define TRACE_SYNC    0x80
+
+#define TRACE_RING_SIZE (1 << 20) // Bytes, must be a power of two
+#define TRACE_MAX_RECORD 16
+
+typedef struct Tracer {
+  // Records are encoded in place, one that runs past the end is copied back
+  // to the start from the extra bytes
+  byte ring[TRACE_RING_SIZE + TRACE_MAX_RECORD];
+
+  // head is only written by the interpreter and tail by the writer thread,
+  // each on its own cache line
+  uint64_t head;
+  byte pad[56];
+  uint64_t tail;
+  byte pad2[56];
+  int stop;
+
+  uint64_t limit; // Interpreter's view of how far head may go
+  FILE *file;
+  pthread_t thread;
+  byte failed; // Set by the writer thread on a write error
+
+  // Last traced state, records hold the differences
+  byte A, X, Y, SP, PS;
+  word lastAddress;
+  word address; // Last data access of the current instruction
+  byte accessed;
+  uint64_t records;
+} Tracer;
+
+extern const byte traceLengths[256];
+
+// Writes the header and starts the writer thread, returns 0 on failure
+byte startTrace(Tracer *tracer, FILE *file);
+// Drains the ring and stops the writer thread, returns 0 if a write failed
+byte stopTrace(Tracer *tracer);
+
+#ifdef EXECUTION_TRACE
+void attachTracer(Memory *memory, Tracer *tracer);
+#endif
+
+void traceSync(Tracer *tracer, const CPU *cpu);
+void traceWait(Tracer *tracer);
+
+/*
+ * Reading
+ */
+
+#define TRACE_MAGIC "C6502TR1"
+#define TRACE_HEADER_SIZE 8
+
+// Machine state after a record. cpu holds the registers, with PS synced, and
+// the address of the next instruction in PC.
+typedef struct {
+  CPU cpu;
+  word PC; // Address of the record's instruction
+  byte tag;
+  byte opcode;
+  word address; // Last data address, valid when tag has TRACE_ADDRESS
+  uint64_t cycles; // Spent up to the end of the record
+  uint64_t records; // Instruction records so far, sync records don't count
+} TraceState;
+
+void initTraceState(TraceState *state);
+// Parses the record at data into state, returns its length, or 0 when it is
+// cut short by size
+size_t readTraceRecord(TraceState *state, const byte *data, size_t size);
+// Every data address the record touched, returns how many (at most 2). They
+// were written when opcodeStores has the opcode, read otherwise.
+byte traceAddresses(const TraceState *state, word addresses[2]);
+
+// One line of text per record
+void writeTraceRecord(FILE *out, const TraceState *state);
+// Turns a trace file back into one line of text per instruction, returns 0
+// if the file is not a trace or ends in the middle of a record
+byte decodeTrace(FILE *in, FILE *out);
+
+/*
+ * Recording, inlined into execute()
+ */
+
+#ifdef EXECUTION_TRACE
+#define TRACE_ACCESS(memory, address) do { \
+  if((memory)->tracer) \
+    traceAccess((memory)->tracer, address); \
+} while(0)
+#else
+#define TRACE_ACCESS(memory, address)
+#endif
+
+static inline byte tracePS(const CPU *cpu) {
+  if(!cpu->lazyFlags)
+    return cpu->PS;
+  return (cpu->PS & ~(ZERO_FLAG | NEGATIVE_FLAG)) |
+    (cpu->result == 0 ? ZERO_FLAG : 0) | (cpu->result & NEGATIVE_FLAG);
+}
+
+static inline byte *traceVarint(byte *out, int delta) {
+  uint value = (word)(((uint)delta << 1) ^ (delta >> 15));
+  while(value >= 0x80) {
+    *out++ = value | 0x80;
+    value >>= 7;
+  }
+  *out++ = value;
+  return out;
+}
+
+static inline void traceAccess(Tracer *tracer, word address) {
+  tracer->address = address;
+  tracer->accessed = 1;
+}
+
+// Publishes the record encoded at head
+static inline void traceCommit(Tracer *tracer, uint length) {
+  uint offset = tracer->head & (TRACE_RING_SIZE - 1);
+  if(offset + length > TRACE_RING_SIZE)
+    memcpy(tracer->ring, tracer->ring + TRACE_RING_SIZE, offset + length - TRACE_RING_SIZE);
+  __atomic_store_n(&tracer->head, tracer->head + length, __ATOMIC_RELEASE);
+}
+
+static inline void traceInstruction(Tracer *tracer, const CPU *cpu, byte opcode, word PC) {
+  if(tracer->head + TRACE_MAX_RECORD > tracer->limit)
+    traceWait(tracer);
+
+  byte *record = tracer->ring + (tracer->head & (TRACE_RING_SIZE - 1));
+  byte *out = record + 2;
+  byte tag = 0;
+  byte PS = tracePS(cpu);
+
+  #define TRACE_REGISTER(bit, value, last) \
+    if((value) != (last)) { tag |= bit; *out++ = (last) = (value); }
+  TRACE_REGISTER(TRACE_A, cpu->A, tracer->A);
+  TRACE_REGISTER(TRACE_X, cpu->X, tracer->X);
+  TRACE_REGISTER(TRACE_Y, cpu->Y, tracer->Y);
+  TRACE_REGISTER(TRACE_SP, cpu->SP, tracer->SP);
+  TRACE_REGISTER(TRACE_PS, PS, tracer->PS);
+  #undef TRACE_REGISTER
+
+  if(tracer->accessed) {
+    tag |= TRACE_ADDRESS;
+    out = traceVarint(out, (int16_t)(tracer->address - tracer->lastAddress));
+    tracer->lastAddress = tracer->address;
+    tracer->accessed = 0;
+  }
+  if(traceLengths[opcode] == 0 || (word)(PC + traceLengths[opcode]) != cpu->PC) {
+    tag |= TRACE_JUMP;
+    out = traceVarint(out, (int16_t)(cpu->PC - PC));
+  }
+  record[0] = tag;
+  record[1] = opcode;
+
+  traceCommit(tracer, out - record);
+  tracer->records++;
+}
+
+#endif
@@ -0,0 +1,278 @@
+#define _DEFAULT_SOURCE // fileno, mmap
+
+#include "traceindex.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_LISTS (MEMORY_SIZE + 1)
+
+// Maps a whole file read only, returns NULL on failure or for empty files
+static void *mapFile(FILE *file, size_t *size) {
+  struct stat info;
+  if(fflush(file) != 0 || fstat(fileno(file), &info) != 0 || info.st_size == 0)
+    return NULL;
+
+  void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  if(map == MAP_FAILED)
+    return NULL;
+  *size = info.st_size;
+  return map;
+}
+
+/*
+ * Building
+ */
+
+typedef struct {
+  uint32_t *chunks;
+  uint32_t count, capacity;
+} ChunkList;
+
+// Adds a chunk to a list once, chunks arrive in ascending order
+static byte addChunk(ChunkList *list, uint32_t chunk) {
+  if(list->count > 0 && list->chunks[list->count - 1] == chunk)
+    return 1;
+  if(list->count == list->capacity) {
+    uint32_t capacity = list->capacity ? list->capacity * 2 : 4;
+    uint32_t *chunks = realloc(list->chunks, capacity * sizeof(uint32_t));
+    if(chunks == NULL)
+      return 0;
+    list->chunks = chunks;
+    list->capacity = capacity;
+  }
+  list->chunks[list->count++] = chunk;
+  return 1;
+}
+
+// Writes where each list starts, counting from the first posting of lists
+static byte writeLists(const ChunkList *lists, uint64_t start, FILE *index) {
+  for(uint i = 0; i < MEMORY_SIZE; i++) {
+    if(fwrite(&start, sizeof(start), 1, index) != 1)
+      return 0;
+    start += lists[i].count;
+  }
+  return fwrite(&start, sizeof(start), 1, index) == 1;
+}
+
+static byte writePostings(const ChunkList *lists, FILE *index) {
+  for(uint i = 0; i < MEMORY_SIZE; i++) {
+    if(lists[i].count > 0 &&
+        fwrite(lists[i].chunks, sizeof(uint32_t), lists[i].count, index) != lists[i].count)
+      return 0;
+  }
+  return 1;
+}
+
+byte buildTraceIndex(FILE *trace, FILE *index) {
+  size_t size;
+  const byte *data = mapFile(trace, &size);
+  if(data == NULL)
+    return 0;
+
+  // Address lists first, then PC lists
+  ChunkList *lists = calloc(2 * MEMORY_SIZE, sizeof(ChunkList));
+  TraceKeyframe *keyframes = NULL;
+  uint64_t chunks = 0, capacity = 0, records = 0, postings = 0;
+  TraceState state;
+  initTraceState(&state);
+  byte ok = lists != NULL && size >= TRACE_HEADER_SIZE &&
+    memcmp(data, TRACE_MAGIC, TRACE_HEADER_SIZE) == 0;
+
+  for(size_t offset = TRACE_HEADER_SIZE; ok && offset < size; records++) {
+    if(records % TRACE_CHUNK_RECORDS == 0) {
+      if(chunks == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        TraceKeyframe *grown = realloc(keyframes, capacity * sizeof(TraceKeyframe));
+        if(grown == NULL) {
+          ok = 0;
+          break;
+        }
+        keyframes = grown;
+      }
+      keyframes[chunks].offset = offset;
+      keyframes[chunks].state = state;
+      chunks++;
+    }
+
+    size_t length = readTraceRecord(&state, data + offset, size - offset);
+    if(length == 0) {
+      ok = 0;
+      break;
+    }
+    offset += length;
+    if(state.tag & TRACE_SYNC)
+      continue;
+
+    uint32_t chunk = chunks - 1;
+    word addresses[2];
+    byte count = traceAddresses(&state, addresses);
+    for(byte i = 0; i < count; i++) {
+      ok = ok && addChunk(&lists[addresses[i]], chunk);
+    }
+    ok = ok && addChunk(&lists[MEMORY_SIZE + state.PC], chunk);
+  }
+
+  if(ok) {
+    uint64_t addressPostings = 0;
+    for(uint i = 0; i < 2 * MEMORY_SIZE; i++) {
+      if(i == MEMORY_SIZE)
+        addressPostings = postings;
+      postings += lists[i].count;
+    }
+    TraceIndexHeader header = { TRACE_INDEX_MAGIC, size, chunks, postings };
+    ok = fwrite(&header, sizeof(header), 1, index) == 1 &&
+      fwrite(keyframes, sizeof(TraceKeyframe), chunks, index) == chunks &&
+      writeLists(lists, 0, index) &&
+      writeLists(lists + MEMORY_SIZE, addressPostings, index) &&
+      writePostings(lists, index) &&
+      writePostings(lists + MEMORY_SIZE, index) &&
+      fflush(index) == 0;
+  }
+
+  if(lists != NULL) {
+    for(uint i = 0; i < 2 * MEMORY_SIZE; i++) {
+      free(lists[i].chunks);
+    }
+  }
+  free(lists);
+  free(keyframes);
+  munmap((void *)data, size);
+  return ok;
+}
+
+/*
+ * Opening
+ */
+
+byte openTraceIndex(TraceIndex *index, FILE *trace, FILE *file) {
+  index->trace = mapFile(trace, &index->traceSize);
+  index->map = mapFile(file, &index->mapSize);
+  if(index->trace == NULL || index->map == NULL) {
+    closeTraceIndex(index);
+    return 0;
+  }
+
+  const byte *map = index->map;
+  const TraceIndexHeader *header = index->header = index->map;
+  if(index->mapSize < sizeof(TraceIndexHeader) ||
+      memcmp(header->magic, TRACE_INDEX_MAGIC, 8) != 0 ||
+      header->traceSize != index->traceSize ||
+      index->mapSize != sizeof(TraceIndexHeader) +
+        header->chunks * sizeof(TraceKeyframe) +
+        2 * TRACE_LISTS * sizeof(uint64_t) +
+        header->postings * sizeof(uint32_t)) {
+    closeTraceIndex(index);
+    return 0;
+  }
+
+  map += sizeof(TraceIndexHeader);
+  index->keyframes = (const TraceKeyframe *)map;
+  map += header->chunks * sizeof(TraceKeyframe);
+  index->addressLists = (const uint64_t *)map;
+  index->PCLists = index->addressLists + TRACE_LISTS;
+  index->postings = (const uint32_t *)(index->PCLists + TRACE_LISTS);
+  return 1;
+}
+
+void closeTraceIndex(TraceIndex *index) {
+  if(index->trace != NULL)
+    munmap((void *)index->trace, index->traceSize);
+  if(index->map != NULL)
+    munmap(index->map, index->mapSize);
+  index->trace = NULL;
+  index->map = NULL;
+}
+
+/*
+ * Queries
+ */
+
+enum { MATCH_WRITE, MATCH_READ, MATCH_PC };
+
+static byte matches(const TraceState *state, byte kind, word address) {
+  if(state->tag & TRACE_SYNC)
+    return 0;
+  if(kind == MATCH_PC)
+    return state->PC == address;
+  if(opcodeStores[state->opcode] != (kind == MATCH_WRITE))
+    return 0;
+
+  word addresses[2];
+  byte count = traceAddresses(state, addresses);
+  for(byte i = 0; i < count; i++) {
+    if(addresses[i] == address)
+      return 1;
+  }
+  return 0;
+}
+
+static uint64_t chunkEnd(const TraceIndex *index, uint32_t chunk) {
+  if(chunk + 1 < index->header->chunks)
+    return index->keyframes[chunk + 1].offset;
+  return index->header->traceSize;
+}
+
+// Decodes every chunk in a list, visiting the matching records
+static uint64_t find(const TraceIndex *index, const uint64_t *lists, byte kind,
+    word address, TraceVisitor visit, void *context) {
+  uint64_t found = 0;
+
+  for(uint64_t i = lists[address]; i < lists[address + 1]; i++) {
+    uint32_t chunk = index->postings[i];
+    TraceState state = index->keyframes[chunk].state;
+    uint64_t end = chunkEnd(index, chunk);
+
+    for(uint64_t offset = index->keyframes[chunk].offset; offset < end;) {
+      size_t length = readTraceRecord(&state, index->trace + offset, end - offset);
+      if(length == 0)
+        break;
+      offset += length;
+      if(matches(&state, kind, address)) {
+        found++;
+        if(visit != NULL)
+          visit(&state, context);
+      }
+    }
+  }
+  return found;
+}
+
+uint64_t findWrites(const TraceIndex *index, word address, TraceVisitor visit, void *context) {
+  return find(index, index->addressLists, MATCH_WRITE, address, visit, context);
+}
+
+uint64_t findReads(const TraceIndex *index, word address, TraceVisitor visit, void *context) {
+  return find(index, index->addressLists, MATCH_READ, address, visit, context);
+}
+
+uint64_t findExecutions(const TraceIndex *index, word PC, TraceVisitor visit, void *context) {
+  return find(index, index->PCLists, MATCH_PC, PC, visit, context);
+}
+
+byte findState(const TraceIndex *index, uint64_t cycle, TraceState *state) {
+  if(index->header->chunks == 0)
+    return 0;
+
+  // Last chunk that starts by the cycle, the first one always does
+  uint64_t low = 0, high = index->header->chunks - 1;
+  while(low < high) {
+    uint64_t middle = low + (high - low + 1) / 2;
+    if(index->keyframes[middle].state.cycles <= cycle)
+      low = middle;
+    else
+      high = middle - 1;
+  }
+
+  *state = index->keyframes[low].state;
+  uint64_t end = chunkEnd(index, low);
+  for(uint64_t offset = index->keyframes[low].offset; offset < end;) {
+    TraceState next = *state;
+    size_t length = readTraceRecord(&next, index->trace + offset, end - offset);
+    if(length == 0 || next.cycles > cycle)
+      break;
+    offset += length;
+    *state = next;
+  }
+  return 1;
+}
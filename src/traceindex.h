@@ -0,0 +1,72 @@
+#ifndef C6502_TRACEINDEX_H
+#define C6502_TRACEINDEX_H
+
+#include "trace.h"
+
+/*
+ * TRACE INDEX
+ *
+ * Answers questions about an execution trace without reading all of it.
+ * The trace is cut into chunks of TRACE_CHUNK_RECORDS records. The index
+ * keeps the machine state at the start of every chunk, and for every data
+ * address and every PC the list of chunks that touch it, so a query only
+ * decodes the chunks it needs.
+ *
+ * The index file is:
+ *
+ *   TraceIndexHeader
+ *   TraceKeyframe[chunks]
+ *   uint64_t[MEMORY_SIZE + 1]  Start of each address list in the postings
+ *   uint64_t[MEMORY_SIZE + 1]  Start of each PC list in the postings
+ *   uint32_t[postings]         Chunk numbers, ascending within a list
+ *
+ * It is written in host byte order and memory-mapped as it is, so it has to
+ * be rebuilt on a different host. The trace is mapped too.
+ */
+
+#define TRACE_INDEX_MAGIC "C6502IX1"
+#define TRACE_CHUNK_RECORDS 4096
+
+typedef struct {
+  char magic[8];
+  uint64_t traceSize; // Bytes of the trace the index was built from
+  uint64_t chunks;
+  uint64_t postings;
+} TraceIndexHeader;
+
+typedef struct {
+  uint64_t offset; // Of the chunk's first record in the trace
+  TraceState state; // Before the chunk's first record
+} TraceKeyframe;
+
+typedef struct {
+  const byte *trace;
+  size_t traceSize;
+  void *map;
+  size_t mapSize;
+
+  const TraceIndexHeader *header;
+  const TraceKeyframe *keyframes;
+  const uint64_t *addressLists;
+  const uint64_t *PCLists;
+  const uint32_t *postings;
+} TraceIndex;
+
+// Called once per matching record, in trace order
+typedef void (*TraceVisitor)(const TraceState *state, void *context);
+
+// Both return 0 when the trace is not one, is cut short, or on I/O errors
+byte buildTraceIndex(FILE *trace, FILE *index);
+byte openTraceIndex(TraceIndex *index, FILE *trace, FILE *file);
+void closeTraceIndex(TraceIndex *index);
+
+// Return the number of matching records
+uint64_t findWrites(const TraceIndex *index, word address, TraceVisitor visit, void *context);
+uint64_t findReads(const TraceIndex *index, word address, TraceVisitor visit, void *context);
+uint64_t findExecutions(const TraceIndex *index, word PC, TraceVisitor visit, void *context);
+
+// State after the last record that finished by the given cycle, returns 0
+// for a trace without records
+byte findState(const TraceIndex *index, uint64_t cycle, TraceState *state);
+
+#endif
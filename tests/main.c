@@ -3,9 +3,25 @@
 #include "test_truth.h"
 #include "test_memory.h"
 #include "test_cpu.h"
+#include "test_machine.h"
 #include "test_lda.h"
 #include "test_ldx.h"
 #include "test_ldy.h"
+#include "test_jsr.h"
+#include "test_dispatch.h"
+#include "test_jit.h"
+#include "test_decode.h"
+#include "test_batch.h"
+#include "test_fleet.h"
+#include "test_snapshot.h"
+#include "test_stats.h"
+#include "test_profiler.h"
+#include "test_callgraph.h"
+#include "test_heatmap.h"
+#include "test_trace.h"
+#include "test_traceindex.h"
+#include "test_scheduler.h"
+#include "test_debugger.h"
 
 int main() {
   CU_initialize_registry();
@@ -13,9 +29,25 @@ int main() {
   run_truth_tests();
   run_memory_tests();
   run_cpu_tests();
+  run_machine_tests();
   run_lda_tests();
   run_ldx_tests();
   run_ldy_tests();
+  run_jsr_tests();
+  run_dispatch_tests();
+  run_jit_tests();
+  run_decode_tests();
+  run_batch_tests();
+  run_fleet_tests();
+  run_snapshot_tests();
+  run_stats_tests();
+  run_profiler_tests();
+  run_callgraph_tests();
+  run_heatmap_tests();
+  run_trace_tests();
+  run_traceindex_tests();
+  run_scheduler_tests();
+  run_debugger_tests();
 
   CU_basic_set_mode(CU_BRM_VERBOSE);
   CU_basic_run_tests();
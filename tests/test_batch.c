@@ -0,0 +1,156 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/batch.h"
+
+#ifdef BATCH_ENGINE
+
+#define TEST_LANES 8
+
+static Batch batch;
+static Memory batchMemory[TEST_LANES];
+static Memory scalarMemory[TEST_LANES];
+
+// Writes a run of loads using every addressing mode
+void writeBatchProgram(Memory *memory, word address) {
+  byte program[] = {
+    OP_LDX_ZP, 0x10,
+    OP_LDY_ABS, 0x00, 0x30,
+    OP_LDA_ZPX, 0xF0,
+    OP_LDA_ABSX, 0xC0, 0x30,
+    OP_LDX_ZPY, 0x20,
+    OP_LDA_ABSY, 0x00, 0x00,
+    OP_LDY_ZPX, 0x00,
+    OP_LDA_IM, 0x00,
+  };
+
+  for(uint i = 0; i < sizeof(program); i++) {
+    writeByte(memory, address + i, program[i]);
+  }
+}
+
+// Gives each lane different inputs
+void writeBatchData(Memory *memory, byte seed) {
+  for(uint i = 0; i < 0x100; i++) {
+    writeByte(memory, i, (byte)(i * (seed + 3)));
+    writeByte(memory, 0x3000 + i, (byte)(i * 5 + seed * 0x40));
+    writeByte(memory, 0x3100 + i, (byte)(i ^ seed));
+  }
+}
+
+void test_batch_matches_scalar() {
+  word startingAddress = 0x0200;
+  initBatch(&batch, TEST_LANES);
+
+  CPU scalarCPU[TEST_LANES];
+  for(uint lane = 0; lane < TEST_LANES; lane++) {
+    CPU cpu;
+    reset(&cpu, &batchMemory[lane]);
+    reset(&scalarCPU[lane], &scalarMemory[lane]);
+    cpu.PC = scalarCPU[lane].PC = startingAddress;
+    writeBatchProgram(&batchMemory[lane], startingAddress);
+    writeBatchProgram(&scalarMemory[lane], startingAddress);
+    writeBatchData(&batchMemory[lane], lane);
+    writeBatchData(&scalarMemory[lane], lane);
+
+    // Each lane runs a different number of instructions, so lanes drop out
+    // at different points. The scalar run tells how many cycles that takes.
+    uint cycles = 1000;
+    for(uint i = 0; i <= lane; i++) {
+      step(&scalarCPU[lane], &scalarMemory[lane], &cycles);
+    }
+    setLane(&batch, lane, &cpu, &batchMemory[lane], 1000 - cycles);
+  }
+
+  executeBatch(&batch);
+
+  for(uint lane = 0; lane < TEST_LANES; lane++) {
+    CPU cpu;
+    getLane(&batch, lane, &cpu);
+
+    CU_ASSERT_EQUAL(batch.cycles[lane], 0);
+    CU_ASSERT_EQUAL(cpu.PC, scalarCPU[lane].PC);
+    CU_ASSERT_EQUAL(cpu.A, scalarCPU[lane].A);
+    CU_ASSERT_EQUAL(cpu.X, scalarCPU[lane].X);
+    CU_ASSERT_EQUAL(cpu.Y, scalarCPU[lane].Y);
+    CU_ASSERT_EQUAL(cpu.PS, scalarCPU[lane].PS);
+  }
+}
+
+void test_batch_divergent_code() {
+  word startingAddress = 0x0200;
+  initBatch(&batch, 2);
+
+  for(uint lane = 0; lane < 2; lane++) {
+    CPU cpu;
+    reset(&cpu, &batchMemory[lane]);
+    cpu.PC = startingAddress;
+    writeByte(&batchMemory[lane], startingAddress, OP_LDA_IM);
+    writeByte(&batchMemory[lane], startingAddress + 0x01, 0x10 + lane);
+    writeByte(&batchMemory[lane], startingAddress + 0x02, lane ? OP_LDX_IM : OP_LDY_IM);
+    writeByte(&batchMemory[lane], startingAddress + 0x03, 0x80);
+    setLane(&batch, lane, &cpu, &batchMemory[lane], 4);
+  }
+
+  executeBatch(&batch);
+
+  CPU first, second;
+  getLane(&batch, 0, &first);
+  getLane(&batch, 1, &second);
+
+  CU_ASSERT_EQUAL(first.A, 0x10);
+  CU_ASSERT_EQUAL(first.Y, 0x80);
+  CU_ASSERT_EQUAL(first.X, 0x00);
+  CU_ASSERT_EQUAL(second.A, 0x11);
+  CU_ASSERT_EQUAL(second.X, 0x80);
+  CU_ASSERT_EQUAL(second.Y, 0x00);
+  CU_ASSERT_EQUAL(batch.cycles[0], 0);
+  CU_ASSERT_EQUAL(batch.cycles[1], 0);
+  CU_ASSERT_TRUE(second.PS & NEGATIVE_FLAG);
+}
+
+static uint deviceReads[2];
+
+// Reads back the low byte of the address, so $D0A9 holds LDA #$AA
+static byte readCodeDevice(void *context, word address) {
+  (*(uint *)context)++;
+  return address & 0xFF;
+}
+
+void test_batch_code_in_device() {
+  word startingAddress = 0xD0A9;
+  initBatch(&batch, 2);
+
+  for(uint lane = 0; lane < 2; lane++) {
+    CPU cpu;
+    Device device = { readCodeDevice, NULL, &deviceReads[lane] };
+    reset(&cpu, &batchMemory[lane]);
+    mapDevice(&batchMemory[lane], 0xD000, MEMORY_PAGE_SIZE, device);
+    deviceReads[lane] = 0;
+    cpu.PC = startingAddress;
+    setLane(&batch, lane, &cpu, &batchMemory[lane], 2);
+  }
+
+  executeBatch(&batch);
+
+  // One read for the opcode and one for the operand, as in step()
+  for(uint lane = 0; lane < 2; lane++) {
+    CPU cpu;
+    getLane(&batch, lane, &cpu);
+    CU_ASSERT_EQUAL(deviceReads[lane], 2);
+    CU_ASSERT_EQUAL(cpu.A, 0xAA);
+    CU_ASSERT_EQUAL(cpu.PC, startingAddress + 0x02);
+    CU_ASSERT_EQUAL(batch.cycles[lane], 0);
+  }
+}
+
+#endif
+
+void run_batch_tests() {
+#ifdef BATCH_ENGINE
+  CU_pSuite suite = CU_add_suite("Batch tests", 0, 0);
+
+  CU_add_test(suite, "Batch lanes match scalar execution", test_batch_matches_scalar);
+  CU_add_test(suite, "Batch lanes with different code", test_batch_divergent_code);
+  CU_add_test(suite, "Batch code in device pages is read once", test_batch_code_in_device);
+#endif
+}
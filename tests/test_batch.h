@@ -0,0 +1,6 @@
+#ifndef TEST_BATCH_H
+#define TEST_BATCH_H
+
+void run_batch_tests();
+
+#endif
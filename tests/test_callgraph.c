@@ -0,0 +1,174 @@
+#include "CUnit/Basic.h"
+#include <string.h>
+#include "../src/6502.h"
+#include "../src/callgraph.h"
+
+static Machine machine;
+static CallProfiler profiler;
+
+static void writeJSR(word address, word target) {
+  writeByte(&machine.memory, address, OP_JSR);
+  writeWord(&machine.memory, address + 1, target);
+}
+
+static void writeLoad(word address, byte opcode, byte value) {
+  writeByte(&machine.memory, address, opcode);
+  writeByte(&machine.memory, address + 1, value);
+}
+
+static void start(word PC) {
+  machine.cpu.PC = PC;
+  machine.cpu.SP = 0xFF;
+  initCallProfiler(&profiler, &machine.cpu);
+}
+
+static uint64_t totalExclusive() {
+  uint64_t total = 0;
+  for(uint i = 0; i < MEMORY_SIZE; i++) {
+    total += profiler.routines[i].exclusive;
+  }
+  return total;
+}
+
+static const CallEdge *edge(word caller, word callee) {
+  for(uint i = 0; i < CALL_GRAPH_EDGES; i++) {
+    if(profiler.edges[i].used && profiler.edges[i].caller == caller &&
+        profiler.edges[i].callee == callee)
+      return &profiler.edges[i];
+  }
+  return NULL;
+}
+
+void test_callgraph_nested_calls() {
+  resetMachine(&machine);
+  writeJSR(0x0200, 0x0300);
+  writeJSR(0x0203, 0x0300);
+  writeLoad(0x0206, OP_LDA_IM, 0x01);
+  writeLoad(0x0300, OP_LDX_IM, 0x01);
+  writeJSR(0x0302, 0x0400);
+  writeByte(&machine.memory, 0x0305, OP_RTS);
+  writeLoad(0x0400, OP_LDY_IM, 0x02);
+  writeByte(&machine.memory, 0x0402, OP_RTS);
+  start(0x0200);
+
+  uint cycles = 58;
+  executeCallProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0208);
+  CU_ASSERT_EQUAL(profiler.clock, 58);
+  CU_ASSERT_EQUAL(profiler.depth, 1);
+
+  CU_ASSERT_EQUAL(profiler.routines[0x0200].exclusive, 14);
+  CU_ASSERT_EQUAL(routineInclusive(&profiler, 0x0200), 58);
+  CU_ASSERT_EQUAL(profiler.routines[0x0300].calls, 2);
+  CU_ASSERT_EQUAL(profiler.routines[0x0300].exclusive, 28);
+  CU_ASSERT_EQUAL(routineInclusive(&profiler, 0x0300), 44);
+  CU_ASSERT_EQUAL(profiler.routines[0x0400].calls, 2);
+  CU_ASSERT_EQUAL(profiler.routines[0x0400].exclusive, 16);
+  CU_ASSERT_EQUAL(routineInclusive(&profiler, 0x0400), 16);
+
+  CU_ASSERT_PTR_NOT_NULL_FATAL(edge(0x0200, 0x0300));
+  CU_ASSERT_EQUAL(edge(0x0200, 0x0300)->calls, 2);
+  CU_ASSERT_EQUAL(edge(0x0200, 0x0300)->cycles, 44);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(edge(0x0300, 0x0400));
+  CU_ASSERT_EQUAL(edge(0x0300, 0x0400)->calls, 2);
+  CU_ASSERT_PTR_NULL(edge(0x0200, 0x0400));
+  freeCallProfiler(&profiler);
+}
+
+void test_callgraph_recursion() {
+  resetMachine(&machine);
+  writeJSR(0x0200, 0x0300);
+  writeJSR(0x0300, 0x0300);
+  start(0x0200);
+
+  uint cycles = 5 * 6;
+  executeCallProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+
+  CU_ASSERT_EQUAL(profiler.depth, 6);
+  CU_ASSERT_EQUAL(profiler.routines[0x0300].calls, 5);
+  CU_ASSERT_EQUAL(profiler.routines[0x0300].exclusive, 24);
+  // Counted once from the outermost call, not once per frame
+  CU_ASSERT_EQUAL(routineInclusive(&profiler, 0x0300), 24);
+  CU_ASSERT_EQUAL(routineInclusive(&profiler, 0x0200), 30);
+  freeCallProfiler(&profiler);
+}
+
+void test_callgraph_unpaired_returns() {
+  resetMachine(&machine);
+  writeJSR(0x0200, 0x0300);
+  writeLoad(0x0210, OP_LDA_IM, 0x01);
+  writeByte(&machine.memory, 0x0212, OP_RTS);
+  writeJSR(0x0300, 0x0400);
+  writeLoad(0x0400, OP_LDA_IM, 0x02);
+  start(0x0200);
+
+  uint cycles = 6 + 6 + 2;
+  executeCallProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+  CU_ASSERT_EQUAL(profiler.depth, 3);
+
+  // A longjmp back to the top level: SP is reloaded, nothing returns
+  machine.cpu.SP = 0xFF;
+  machine.cpu.PC = 0x0210;
+  cycles = 2;
+  executeCallProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+
+  CU_ASSERT_EQUAL(profiler.depth, 1);
+  CU_ASSERT_EQUAL(profiler.routines[0x0400].exclusive, 4);
+  CU_ASSERT_EQUAL(routineInclusive(&profiler, 0x0400), 4);
+  CU_ASSERT_EQUAL(routineInclusive(&profiler, 0x0300), 10);
+  CU_ASSERT_EQUAL(profiler.routines[0x0300].active, 0);
+
+  // An RTS with no call behind it: the top level can't be popped
+  writeByte(&machine.memory, 0x0100, 0x7F);
+  writeByte(&machine.memory, 0x0101, 0x02);
+  cycles = 6;
+  executeCallProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0280);
+  CU_ASSERT_EQUAL(profiler.depth, 1);
+  CU_ASSERT_EQUAL(profiler.clock, 22);
+  CU_ASSERT_EQUAL(totalExclusive(), profiler.clock);
+  CU_ASSERT_EQUAL(routineInclusive(&profiler, 0x0200), profiler.clock);
+  freeCallProfiler(&profiler);
+}
+
+void test_callgraph_reports() {
+  char text[1024] = { 0 };
+  resetMachine(&machine);
+  writeJSR(0x0200, 0x0300);
+  writeByte(&machine.memory, 0x0300, OP_RTS);
+  start(0x0200);
+
+  FILE *labels = tmpfile();
+  fputs("al C:0200 .main\nal C:0300 .work\n", labels);
+  rewind(labels);
+  loadVICELabels(&profiler.symbols, labels);
+  fclose(labels);
+
+  uint cycles = 12;
+  executeCallProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+
+  FILE *out = tmpfile();
+  writeCallProfile(&profiler, out);
+  writeCallGraph(&profiler, out);
+  rewind(out);
+  fread(text, 1, sizeof(text) - 1, out);
+  fclose(out);
+
+  CU_ASSERT_PTR_NOT_NULL(strstr(text, "100.00%  main\n"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(text, "50.00%  work\n"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(text, "r0300 [label=\"work\\ninclusive 6\\nexclusive 6\"];\n"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(text, "r0200 -> r0300 [label=\"1\"];\n"));
+  freeCallProfiler(&profiler);
+}
+
+void run_callgraph_tests() {
+  CU_pSuite suite = CU_add_suite("Call graph profiler tests", 0, 0);
+
+  CU_add_test(suite, "Nested calls", test_callgraph_nested_calls);
+  CU_add_test(suite, "Recursion is counted once", test_callgraph_recursion);
+  CU_add_test(suite, "Unpaired returns keep totals consistent", test_callgraph_unpaired_returns);
+  CU_add_test(suite, "Profile and call graph reports", test_callgraph_reports);
+}
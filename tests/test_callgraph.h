@@ -0,0 +1,6 @@
+#ifndef TEST_CALLGRAPH_H
+#define TEST_CALLGRAPH_H
+
+void run_callgraph_tests();
+
+#endif
@@ -14,6 +14,22 @@ void test_cpu_reset() {
   CU_ASSERT_EQUAL(cpu.PS, (UNUSED_FLAG | IRQ_DISABLE_FLAG));
 }
 
+void test_cpu_reset_keeps_memory() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+
+  writeByte(&memory, 0x1234, 0xAB);
+  cpu.PC = 0x1000;
+  cpu.A = 0x42;
+  resetCPU(&cpu);
+
+  CU_ASSERT_EQUAL(cpu.PC, 0xFFFC);
+  CU_ASSERT_EQUAL(cpu.A, 0);
+  CU_ASSERT_EQUAL(cpu.PS, (UNUSED_FLAG | IRQ_DISABLE_FLAG));
+  CU_ASSERT_EQUAL(readByte(&memory, 0x1234), 0xAB);
+}
+
 void test_fetch_byte() {
   CPU cpu;
   Memory memory;
@@ -50,10 +66,54 @@ void test_fetch_word() {
   CU_ASSERT_EQUAL(cycles, 0);
 }
 
+void test_lazy_flags_sync() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+
+  word startingAddress = 0x0100;
+  cpu.PC = startingAddress;
+  writeByte(&memory, startingAddress, OP_LDA_IM);
+  writeByte(&memory, startingAddress + 0x01, 0x80);
+  writeByte(&memory, startingAddress + 0x02, OP_LDA_IM);
+  writeByte(&memory, startingAddress + 0x03, 0x01);
+
+  uint cycles = 2;
+  execute(&cpu, &memory, &cycles);
+
+  CU_ASSERT_FALSE(cpu.lazyFlags);
+  CU_ASSERT_TRUE(cpu.PS & NEGATIVE_FLAG);
+
+  // Flags written between runs survive, except the ones the next load sets
+  cpu.PS = 0xFF;
+  cycles = 2;
+  execute(&cpu, &memory, &cycles);
+
+  CU_ASSERT_FALSE(cpu.lazyFlags);
+  CU_ASSERT_EQUAL(cpu.PS, 0xFF & ~(ZERO_FLAG | NEGATIVE_FLAG));
+}
+
+void test_set_ps_syncs_lazy_flags() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+
+  byte value = 0x80;
+  setNZ(&cpu, 0x00);
+  setPS(&cpu, &value, NEGATIVE_FLAG);
+
+  CU_ASSERT_FALSE(cpu.lazyFlags);
+  CU_ASSERT_TRUE(cpu.PS & ZERO_FLAG);
+  CU_ASSERT_TRUE(cpu.PS & NEGATIVE_FLAG);
+}
+
 void run_cpu_tests() {
   CU_pSuite suite = CU_add_suite("CPU tests", 0, 0);
 
   CU_add_test(suite, "CPU reset", test_cpu_reset);
+  CU_add_test(suite, "CPU reset keeps memory", test_cpu_reset_keeps_memory);
   CU_add_test(suite, "Fetch byte", test_fetch_byte);
   CU_add_test(suite, "Fetch word", test_fetch_word);
+  CU_add_test(suite, "Lazy flags are synced after execute", test_lazy_flags_sync);
+  CU_add_test(suite, "setPS syncs lazy flags first", test_set_ps_syncs_lazy_flags);
 }
\ No newline at end of file
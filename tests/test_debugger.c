@@ -0,0 +1,173 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/debugger.h"
+#include "../src/scheduler.h"
+
+static Machine machine, reference;
+static Debugger debugger;
+
+// LDA #$01, LDX $10, LDY #$03, JSR $0300
+static void loadProgram(Machine *target) {
+  resetMachine(target);
+  target->cpu.PC = 0x0200;
+  target->cpu.SP = 0xFF;
+  writeByte(&target->memory, 0x0010, 0x42);
+  writeByte(&target->memory, 0x0200, OP_LDA_IM);
+  writeByte(&target->memory, 0x0201, 0x01);
+  writeByte(&target->memory, 0x0202, OP_LDX_ZP);
+  writeByte(&target->memory, 0x0203, 0x10);
+  writeByte(&target->memory, 0x0204, OP_LDY_IM);
+  writeByte(&target->memory, 0x0205, 0x03);
+  writeByte(&target->memory, 0x0206, OP_JSR);
+  writeWord(&target->memory, 0x0207, 0x0300);
+  writeByte(&target->memory, 0x0300, OP_LDA_IM);
+  writeByte(&target->memory, 0x0301, 0x04);
+}
+
+void test_debugger_breakpoint() {
+  loadProgram(&machine);
+  attachDebugger(&machine.memory, &debugger);
+  setWatch(&debugger, 0x0204, WATCH_EXECUTE);
+
+  uint cycles = 100;
+  CU_ASSERT_EQUAL(runMachine(&machine, &cycles), STOP_BREAKPOINT);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0204);
+  CU_ASSERT_EQUAL(machine.cpu.X, 0x42);
+  CU_ASSERT_EQUAL(machine.cpu.Y, 0x00);
+  CU_ASSERT_EQUAL(cycles, 100 - 2 - 3);
+  CU_ASSERT_EQUAL(debugger.stop, STOP_BREAKPOINT);
+  CU_ASSERT_EQUAL(debugger.address, 0x0204);
+
+  // Continuing runs the instruction at the breakpoint
+  cycles = 2;
+  CU_ASSERT_EQUAL(runMachine(&machine, &cycles), STOP_BUDGET);
+  CU_ASSERT_EQUAL(machine.cpu.Y, 0x03);
+  CU_ASSERT_EQUAL(cycles, 0);
+}
+
+void test_debugger_watchpoints() {
+  loadProgram(&machine);
+  attachDebugger(&machine.memory, &debugger);
+  setWatch(&debugger, 0x0010, WATCH_READ);
+  setWatch(&debugger, 0x01FE, WATCH_WRITE);
+
+  // Stops after the instruction that read
+  uint cycles = 100;
+  CU_ASSERT_EQUAL(runMachine(&machine, &cycles), STOP_READ);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0204);
+  CU_ASSERT_EQUAL(machine.cpu.X, 0x42);
+  CU_ASSERT_EQUAL(debugger.address, 0x0010);
+
+  // JSR pushes to 0x01FF, then to 0x01FE
+  CU_ASSERT_EQUAL(runMachine(&machine, &cycles), STOP_WRITE);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0300);
+  CU_ASSERT_EQUAL(debugger.address, 0x01FE);
+  CU_ASSERT_EQUAL(cycles, 100 - 2 - 3 - 2 - 6);
+
+  // Writes from outside the CPU don't count
+  writeByte(&machine.memory, 0x01FE, 0x00);
+  cycles = 2;
+  CU_ASSERT_EQUAL(runMachine(&machine, &cycles), STOP_BUDGET);
+  CU_ASSERT_EQUAL(machine.cpu.A, 0x04);
+}
+
+void test_debugger_step_runs_unwatched() {
+  loadProgram(&machine);
+  attachDebugger(&machine.memory, &debugger);
+  setWatch(&debugger, 0x0010, WATCH_READ);
+
+  // step() has no watch hooks, only execute() reports the read
+  uint cycles = 5;
+  step(&machine.cpu, &machine.memory, &cycles);
+  step(&machine.cpu, &machine.memory, &cycles);
+  CU_ASSERT_EQUAL(machine.cpu.X, 0x42);
+  CU_ASSERT_EQUAL(debugger.stop, STOP_BUDGET);
+
+  machine.cpu.PC = 0x0202;
+  cycles = 100;
+  CU_ASSERT_EQUAL(runMachine(&machine, &cycles), STOP_READ);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0204);
+}
+
+void test_debugger_page_flags() {
+  loadProgram(&machine);
+  attachDebugger(&machine.memory, &debugger);
+  CU_ASSERT_EQUAL(machine.memory.watchPages[0x12], 0);
+
+  setWatch(&debugger, 0x1234, WATCH_READ | WATCH_WRITE);
+  setWatch(&debugger, 0x1256, WATCH_READ);
+  CU_ASSERT_EQUAL(machine.memory.watchPages[0x12], WATCH_READ | WATCH_WRITE);
+  CU_ASSERT_TRUE(isWatched(&debugger, 0x1234, WATCH_WRITE));
+  CU_ASSERT_FALSE(isWatched(&debugger, 0x1235, WATCH_WRITE));
+  CU_ASSERT_FALSE(isWatched(&debugger, 0x1234, WATCH_EXECUTE));
+
+  // The page keeps a kind while another address has it
+  clearWatch(&debugger, 0x1234, WATCH_READ | WATCH_WRITE);
+  CU_ASSERT_EQUAL(machine.memory.watchPages[0x12], WATCH_READ);
+  clearWatch(&debugger, 0x1256, WATCH_READ);
+  CU_ASSERT_EQUAL(machine.memory.watchPages[0x12], 0);
+
+  // Reset detaches the debugger
+  resetMachine(&machine);
+  CU_ASSERT_PTR_NULL(machine.memory.debugger);
+  CU_ASSERT_EQUAL(machine.memory.watchPages[0x02], 0);
+}
+
+// Watches on the program's pages that never hit don't change the run
+void test_debugger_runs_like_execute() {
+  loadProgram(&machine);
+  loadProgram(&reference);
+  attachDebugger(&machine.memory, &debugger);
+  setWatch(&debugger, 0x0201, WATCH_EXECUTE);
+  setWatch(&debugger, 0x0011, WATCH_READ);
+  setWatch(&debugger, 0x01FD, WATCH_WRITE);
+
+  uint cycles = 15, referenceCycles = 15;
+  CU_ASSERT_EQUAL(runMachine(&machine, &cycles), STOP_BUDGET);
+  runMachine(&reference, &referenceCycles);
+
+  CU_ASSERT_EQUAL(cycles, referenceCycles);
+  CU_ASSERT_EQUAL(machine.cpu.PC, reference.cpu.PC);
+  CU_ASSERT_EQUAL(machine.cpu.SP, reference.cpu.SP);
+  CU_ASSERT_EQUAL(machine.cpu.A, reference.cpu.A);
+  CU_ASSERT_EQUAL(machine.cpu.X, reference.cpu.X);
+  CU_ASSERT_EQUAL(machine.cpu.Y, reference.cpu.Y);
+  CU_ASSERT_EQUAL(machine.cpu.PS, reference.cpu.PS);
+}
+
+void test_debugger_stops_scheduler() {
+  loadProgram(&machine);
+  attachDebugger(&machine.memory, &debugger);
+  setWatch(&debugger, 0x0300, WATCH_EXECUTE);
+
+  Scheduler scheduler;
+  initScheduler(&scheduler);
+  CU_ASSERT_EQUAL(runScheduled(&scheduler, &machine, 10000), STOP_BREAKPOINT);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0300);
+  CU_ASSERT_EQUAL(scheduler.clock, 2 + 3 + 2 + 6);
+}
+
+void test_debugger_stops_run_until() {
+  loadProgram(&machine);
+  attachDebugger(&machine.memory, &debugger);
+  setWatch(&debugger, 0x0206, WATCH_EXECUTE);
+
+  uint64_t clock = 1000;
+  RunResult result = runUntil(&machine, &clock, 2000);
+  CU_ASSERT_EQUAL(result.stop, STOP_BREAKPOINT);
+  CU_ASSERT_EQUAL(result.instructions, 3);
+  CU_ASSERT_EQUAL(result.cycles, 2 + 3 + 2);
+  CU_ASSERT_EQUAL(clock, 1000 + 2 + 3 + 2);
+}
+
+void run_debugger_tests() {
+  CU_pSuite suite = CU_add_suite("Debugger tests", 0, 0);
+
+  CU_add_test(suite, "Breakpoints stop before the instruction", test_debugger_breakpoint);
+  CU_add_test(suite, "Watchpoints stop after the access", test_debugger_watchpoints);
+  CU_add_test(suite, "Step doesn't report accesses", test_debugger_step_runs_unwatched);
+  CU_add_test(suite, "Page flags follow the bitmaps", test_debugger_page_flags);
+  CU_add_test(suite, "Runs like execute() between stops", test_debugger_runs_like_execute);
+  CU_add_test(suite, "Stops the scheduler", test_debugger_stops_scheduler);
+  CU_add_test(suite, "Stops run until", test_debugger_stops_run_until);
+}
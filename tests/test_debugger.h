@@ -0,0 +1,6 @@
+#ifndef TEST_DEBUGGER_H
+#define TEST_DEBUGGER_H
+
+void run_debugger_tests();
+
+#endif
@@ -0,0 +1,207 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/decode.h"
+#include "../src/superinstructions.h"
+
+static DecodeCache cache;
+
+// Writes a run of loads using every addressing mode, and returns its cycles
+uint writeDecodeProgram(Memory *memory, word address) {
+  byte program[] = {
+    OP_LDX_IM, 0x04,
+    OP_LDY_IM, 0x80,
+    OP_LDA_ZP, 0x20,
+    OP_LDA_ZPX, 0xFE,
+    OP_LDA_ABSX, 0xFE, 0x30,
+    OP_LDX_ZPY, 0x90,
+    OP_LDY_ABS, 0x02, 0x30,
+    OP_LDA_ABSY, 0x10, 0x00,
+    OP_LDA_IM, 0x00,
+  };
+
+  for(uint i = 0; i < sizeof(program); i++) {
+    writeByte(memory, address + i, program[i]);
+  }
+
+  return 2 + 2 + 3 + 4 + 5 + 4 + 4 + 4 + 2;
+}
+
+void writeDecodeData(Memory *memory, byte seed) {
+  for(uint i = 0; i < 0x100; i++) {
+    writeByte(memory, i, (byte)(i * seed));
+    writeByte(memory, 0x3000 + i, (byte)(i + seed));
+    writeByte(memory, 0x3100 + i, (byte)(i ^ seed));
+  }
+}
+
+void test_decode_matches_interpreter() {
+  CPU decodedCPU, cpu;
+  Memory decodedMemory, memory;
+  reset(&decodedCPU, &decodedMemory);
+  reset(&cpu, &memory);
+  initDecodeCache(&cache);
+
+  word startingAddress = 0x0200;
+  uint programCycles = writeDecodeProgram(&decodedMemory, startingAddress);
+  writeDecodeProgram(&memory, startingAddress);
+
+  for(int i = 0; i < 4; i++) {
+    writeDecodeData(&decodedMemory, i);
+    writeDecodeData(&memory, i);
+    decodedCPU.PC = cpu.PC = startingAddress;
+    uint decodedCycles = programCycles, cycles = programCycles;
+
+    executeDecoded(&cache, &decodedCPU, &decodedMemory, &decodedCycles);
+    execute(&cpu, &memory, &cycles);
+
+    CU_ASSERT_EQUAL(decodedCycles, cycles);
+    CU_ASSERT_EQUAL(decodedCPU.PC, cpu.PC);
+    CU_ASSERT_EQUAL(decodedCPU.A, cpu.A);
+    CU_ASSERT_EQUAL(decodedCPU.X, cpu.X);
+    CU_ASSERT_EQUAL(decodedCPU.Y, cpu.Y);
+    CU_ASSERT_EQUAL(decodedCPU.PS, cpu.PS);
+  }
+
+  CU_ASSERT_PTR_NOT_NULL(cache.instructions[startingAddress].handler);
+  CU_ASSERT_EQUAL(cache.instructions[startingAddress + 0x08].operand, 0x30FE);
+}
+
+void test_decode_self_modifying_code() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+  initDecodeCache(&cache);
+
+  word startingAddress = 0x0200;
+  uint programCycles = writeDecodeProgram(&memory, startingAddress);
+  writeDecodeData(&memory, 3);
+
+  cpu.PC = startingAddress;
+  uint cycles = programCycles;
+  executeDecoded(&cache, &cpu, &memory, &cycles);
+  CU_ASSERT_EQUAL(cpu.A, 0x00);
+
+  // Patch the operand of the last LDA #$00
+  writeByte(&memory, startingAddress + 0x14, 0x42);
+  cpu.PC = startingAddress;
+  cycles = programCycles;
+  executeDecoded(&cache, &cpu, &memory, &cycles);
+
+  CU_ASSERT_EQUAL(cpu.A, 0x42);
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_FALSE(cpu.PS & ZERO_FLAG);
+}
+
+void test_decode_page_straddle() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+  initDecodeCache(&cache);
+
+  // LDA $1234 with its operand split across two pages
+  word startingAddress = 0x02FE;
+  writeByte(&memory, startingAddress, OP_LDA_ABS);
+  writeWord(&memory, startingAddress + 0x01, 0x1234);
+  writeByte(&memory, 0x1234, 0x55);
+
+  cpu.PC = startingAddress;
+  uint cycles = 4;
+  executeDecoded(&cache, &cpu, &memory, &cycles);
+
+  CU_ASSERT_EQUAL(cpu.A, 0x55);
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(cpu.PC, startingAddress + 0x03);
+  CU_ASSERT_PTR_NULL(cache.instructions[startingAddress].handler);
+}
+
+static const byte fusedPairs[][2] = {
+#define FUSED_PAIR(first, second) { OP_##first, OP_##second },
+  SUPERINSTRUCTIONS(FUSED_PAIR)
+  { 0, 0 } // Keeps the list valid when nothing is fused
+};
+
+static const byte lengths[256] = {
+#define DECODE_LENGTH(name, mode, reg) [OP_##name] = LENGTH_##mode,
+  INSTRUCTIONS(DECODE_LENGTH)
+};
+
+static const byte baseCycles[256] = {
+#define DECODE_CYCLES(name, mode, reg) [OP_##name] = CYCLES_##mode,
+  INSTRUCTIONS(DECODE_CYCLES)
+};
+
+// Writes a pair reading writeDecodeData() addresses without crossing pages
+// when indexed by 0x20, returns the address after it
+static word writePair(Memory *memory, word address, const byte *pair) {
+  for(int i = 0; i < 2; i++) {
+    writeByte(memory, address, pair[i]);
+    writeWord(memory, address + 1, 0x3010 + i);
+    address += lengths[pair[i]];
+  }
+  return address;
+}
+
+void test_decode_superinstructions() {
+  CPU decodedCPU, cpu;
+  Memory decodedMemory, memory;
+
+  for(uint i = 0; i + 1 < sizeof(fusedPairs) / sizeof(fusedPairs[0]); i++) {
+    // A budget that ends with the first, and one that starts the second
+    for(int second = 0; second < 2; second++) {
+      reset(&decodedCPU, &decodedMemory);
+      reset(&cpu, &memory);
+      initDecodeCache(&cache);
+      writeDecodeData(&decodedMemory, i + 1);
+      writeDecodeData(&memory, i + 1);
+      decodedCPU.X = cpu.X = decodedCPU.Y = cpu.Y = 0x20;
+
+      word startingAddress = 0x0200;
+      writePair(&decodedMemory, startingAddress, fusedPairs[i]);
+      writePair(&memory, startingAddress, fusedPairs[i]);
+      decodedCPU.PC = cpu.PC = startingAddress;
+      uint decodedCycles = baseCycles[fusedPairs[i][0]] + second, cycles = decodedCycles;
+
+      executeDecoded(&cache, &decodedCPU, &decodedMemory, &decodedCycles);
+      execute(&cpu, &memory, &cycles);
+
+      CU_ASSERT_NOT_EQUAL(cache.instructions[startingAddress].nextLength, 0);
+      CU_ASSERT_EQUAL(decodedCycles, cycles);
+      CU_ASSERT_EQUAL(decodedCPU.PC, cpu.PC);
+      CU_ASSERT_EQUAL(decodedCPU.A, cpu.A);
+      CU_ASSERT_EQUAL(decodedCPU.X, cpu.X);
+      CU_ASSERT_EQUAL(decodedCPU.Y, cpu.Y);
+      CU_ASSERT_EQUAL(decodedCPU.PS, cpu.PS);
+    }
+  }
+}
+
+void test_decode_superinstruction_page_end() {
+  CPU cpu;
+  Memory memory;
+  if(sizeof(fusedPairs) / sizeof(fusedPairs[0]) == 1)
+    return;
+
+  reset(&cpu, &memory);
+  initDecodeCache(&cache);
+
+  // The second instruction starts on the next page
+  word startingAddress = 0x0300 - lengths[fusedPairs[0][0]];
+  writePair(&memory, startingAddress, fusedPairs[0]);
+  cpu.PC = startingAddress;
+  uint cycles = 1;
+  executeDecoded(&cache, &cpu, &memory, &cycles);
+
+  CU_ASSERT_PTR_NOT_NULL(cache.instructions[startingAddress].handler);
+  CU_ASSERT_EQUAL(cache.instructions[startingAddress].nextLength, 0);
+  CU_ASSERT_EQUAL(cpu.PC, 0x0300);
+}
+
+void run_decode_tests() {
+  CU_pSuite suite = CU_add_suite("Decode cache tests", 0, 0);
+
+  CU_add_test(suite, "Decoded execution matches the interpreter", test_decode_matches_interpreter);
+  CU_add_test(suite, "Decode cache drops pages on self-modifying code", test_decode_self_modifying_code);
+  CU_add_test(suite, "Instructions straddling pages are interpreted", test_decode_page_straddle);
+  CU_add_test(suite, "Superinstructions match the interpreter", test_decode_superinstructions);
+  CU_add_test(suite, "Superinstructions stay within a page", test_decode_superinstruction_page_end);
+}
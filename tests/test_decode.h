@@ -0,0 +1,6 @@
+#ifndef TEST_DECODE_H
+#define TEST_DECODE_H
+
+void run_decode_tests();
+
+#endif
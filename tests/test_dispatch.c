@@ -0,0 +1,85 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+
+// Writes a program that uses every implemented opcode, starting at address.
+// Returns the number of cycles it takes to run it.
+uint writeDispatchProgram(Memory *memory, word address) {
+  byte program[] = {
+    OP_LDX_IM, 0x04,
+    OP_LDY_IM, 0x80,
+    OP_LDA_IM, 0x00,
+    OP_LDA_ZP, 0x20,
+    OP_LDA_ZPX, 0x20,
+    OP_LDA_ABS, 0x00, 0x30,
+    OP_LDA_ABSX, 0xFE, 0x30,
+    OP_LDA_ABSY, 0x00, 0x00,
+    OP_LDX_ZP, 0x21,
+    OP_LDX_ZPY, 0x10,
+    OP_LDX_ABS, 0x01, 0x30,
+    OP_LDX_ABSY, 0x00, 0x30,
+    OP_LDY_ZP, 0x22,
+    OP_LDY_ZPX, 0x00,
+    OP_LDY_ABS, 0x02, 0x30,
+    OP_LDY_ABSX, 0x00, 0x00,
+  };
+
+  for(uint i = 0; i < sizeof(program); i++) {
+    writeByte(memory, address + i, program[i]);
+  }
+  for(uint i = 0; i < 0x100; i++) {
+    writeByte(memory, i, (byte)(i * 7));
+    writeByte(memory, 0x3000 + i, (byte)(0xFF - i));
+  }
+
+  return 2 + 2 + 2 + 3 + 4 + 4 + 5 + 4 + 3 + 4 + 4 + 5 + 3 + 4 + 4 + 4;
+}
+
+void test_dispatch_matches_table() {
+  CPU threadedCPU, tableCPU;
+  Memory threadedMemory, tableMemory;
+  reset(&threadedCPU, &threadedMemory);
+  reset(&tableCPU, &tableMemory);
+
+  word startingAddress = 0x0200;
+  threadedCPU.PC = tableCPU.PC = startingAddress;
+  uint threadedCycles = writeDispatchProgram(&threadedMemory, startingAddress);
+  uint tableCycles = writeDispatchProgram(&tableMemory, startingAddress);
+
+  execute(&threadedCPU, &threadedMemory, &threadedCycles);
+  executeTable(&tableCPU, &tableMemory, &tableCycles);
+
+  CU_ASSERT_EQUAL(threadedCycles, 0);
+  CU_ASSERT_EQUAL(tableCycles, 0);
+  CU_ASSERT_EQUAL(threadedCPU.PC, tableCPU.PC);
+  CU_ASSERT_EQUAL(threadedCPU.A, tableCPU.A);
+  CU_ASSERT_EQUAL(threadedCPU.X, tableCPU.X);
+  CU_ASSERT_EQUAL(threadedCPU.Y, tableCPU.Y);
+  CU_ASSERT_EQUAL(threadedCPU.PS, tableCPU.PS);
+}
+
+void test_dispatch_stops_on_budget() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+
+  word startingAddress = 0x0200;
+  cpu.PC = startingAddress;
+  writeDispatchProgram(&memory, startingAddress);
+
+  uint cycles = 6; // LDX #, LDY #, LDA #
+  execute(&cpu, &memory, &cycles);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(cpu.PC, startingAddress + 0x06);
+  CU_ASSERT_EQUAL(cpu.X, 0x04);
+  CU_ASSERT_EQUAL(cpu.Y, 0x80);
+  CU_ASSERT_EQUAL(cpu.A, 0x00);
+  CU_ASSERT_TRUE(cpu.PS & ZERO_FLAG);
+}
+
+void run_dispatch_tests() {
+  CU_pSuite suite = CU_add_suite("Dispatch tests", 0, 0);
+
+  CU_add_test(suite, "Threaded dispatch matches table dispatch", test_dispatch_matches_table);
+  CU_add_test(suite, "Threaded dispatch stops when cycles run out", test_dispatch_stops_on_budget);
+}
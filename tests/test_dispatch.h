@@ -0,0 +1,6 @@
+#ifndef TEST_DISPATCH_H
+#define TEST_DISPATCH_H
+
+void run_dispatch_tests();
+
+#endif
@@ -0,0 +1,75 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/fleet.h"
+
+#define FLEET_JOBS 200
+
+static FleetJob jobs[FLEET_JOBS];
+static byte images[FLEET_JOBS][8];
+static byte finished[FLEET_JOBS];
+
+void recordFinish(FleetJob *job, Machine *machine) {
+  byte *flag = job->context;
+  *flag = machine->memory.data[0x0300] == OP_LDA_IM;
+}
+
+void test_fleet_runs_every_job() {
+  for(uint i = 0; i < FLEET_JOBS; i++) {
+    byte program[] = {
+      OP_LDA_IM, (byte)i,
+      OP_LDX_IM, (byte)(i * 3),
+      OP_LDY_ZP, 0x00,
+    };
+    for(uint j = 0; j < sizeof(program); j++) {
+      images[i][j] = program[j];
+    }
+
+    FleetJob *job = &jobs[i];
+    job->image = images[i];
+    job->imageSize = sizeof(program);
+    job->loadAddress = 0x0300;
+    Memory memory;
+    reset(&job->cpu, &memory);
+    job->cpu.PC = 0x0300;
+    job->cycles = 7;
+    job->finish = recordFinish;
+    job->context = &finished[i];
+    finished[i] = 0;
+  }
+
+  CU_ASSERT_TRUE(runFleet(jobs, FLEET_JOBS, 4));
+
+  for(uint i = 0; i < FLEET_JOBS; i++) {
+    CU_ASSERT_EQUAL(jobs[i].cycles, 0);
+    CU_ASSERT_EQUAL(jobs[i].cpu.PC, 0x0306);
+    CU_ASSERT_EQUAL(jobs[i].cpu.A, (byte)i);
+    CU_ASSERT_EQUAL(jobs[i].cpu.X, (byte)(i * 3));
+    CU_ASSERT_EQUAL(jobs[i].cpu.Y, 0x00);
+    CU_ASSERT_TRUE(jobs[i].cpu.PS & ZERO_FLAG);
+    CU_ASSERT_TRUE(finished[i]);
+  }
+}
+
+void test_fleet_more_threads_than_jobs() {
+  FleetJob job = { 0 };
+  Memory memory;
+  reset(&job.cpu, &memory);
+  byte program[] = { OP_LDA_IM, 0x42 };
+  job.image = program;
+  job.imageSize = sizeof(program);
+  job.loadAddress = 0x0400;
+  job.cpu.PC = 0x0400;
+  job.cycles = 2;
+
+  CU_ASSERT_TRUE(runFleet(&job, 1, 0));
+
+  CU_ASSERT_EQUAL(job.cpu.A, 0x42);
+  CU_ASSERT_EQUAL(job.cycles, 0);
+}
+
+void run_fleet_tests() {
+  CU_pSuite suite = CU_add_suite("Fleet tests", 0, 0);
+
+  CU_add_test(suite, "Fleet runs every job", test_fleet_runs_every_job);
+  CU_add_test(suite, "Fleet with more threads than jobs", test_fleet_more_threads_than_jobs);
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_FLEET_H
+#define TEST_FLEET_H
+
+void run_fleet_tests();
+
+#endif
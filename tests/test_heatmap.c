@@ -0,0 +1,110 @@
+#include "CUnit/Basic.h"
+#include <string.h>
+#include "../src/6502.h"
+#include "../src/heatmap.h"
+
+static HeatMap heatmap, loaded;
+
+#ifdef MEMORY_HEATMAP
+
+static Machine machine;
+
+void test_heatmap_counts_accesses() {
+  resetMachine(&machine);
+
+  word startingAddress = 0x0200;
+  machine.cpu.PC = startingAddress;
+  machine.cpu.SP = 0xFF;
+  writeByte(&machine.memory, startingAddress, OP_LDA_ZP);
+  writeByte(&machine.memory, startingAddress + 0x01, 0x10);
+  writeByte(&machine.memory, startingAddress + 0x02, OP_LDX_ABS);
+  writeWord(&machine.memory, startingAddress + 0x03, 0x0010);
+  writeByte(&machine.memory, startingAddress + 0x05, OP_JSR);
+  writeWord(&machine.memory, startingAddress + 0x06, 0x0300);
+
+  clearHeatMap(&heatmap);
+  attachHeatMap(&machine.memory, &heatmap);
+  uint cycles = 3 + 4 + 6;
+  runMachine(&machine, &cycles);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(heatmap.reads[0x0010], 2);
+  CU_ASSERT_EQUAL(heatmap.fetches[startingAddress], 1);
+  CU_ASSERT_EQUAL(heatmap.fetches[startingAddress + 0x01], 1);
+  CU_ASSERT_EQUAL(heatmap.fetches[startingAddress + 0x04], 1);
+  CU_ASSERT_EQUAL(heatmap.reads[startingAddress], 0);
+  CU_ASSERT_EQUAL(heatmap.writes[0x01FF], 1);
+  CU_ASSERT_EQUAL(heatmap.writes[0x01FE], 1);
+  CU_ASSERT_EQUAL(heatmap.writes[startingAddress], 0);
+
+  // Reset detaches the map
+  resetMachine(&machine);
+  writeByte(&machine.memory, 0x0010, 0x01);
+  CU_ASSERT_EQUAL(heatmap.writes[0x0010], 0);
+}
+
+#endif
+
+void test_heatmap_file() {
+  clearHeatMap(&heatmap);
+  heatmap.reads[0x0010] = 3;
+  heatmap.writes[0xFFFF] = 0xFFFFFFFF;
+  heatmap.fetches[0x1234] = 0x01020304;
+
+  FILE *file = tmpfile();
+  CU_ASSERT_TRUE(writeHeatMap(&heatmap, file));
+  CU_ASSERT_EQUAL(ftell(file), 8 + 3 * 4 * MEMORY_SIZE);
+
+  rewind(file);
+  CU_ASSERT_TRUE(readHeatMap(&loaded, file));
+  CU_ASSERT_EQUAL(memcmp(&heatmap, &loaded, sizeof(HeatMap)), 0);
+
+  // Counters are little-endian whatever the host
+  byte bytes[4];
+  fseek(file, 8 + 2 * 4 * MEMORY_SIZE + 4 * 0x1234, SEEK_SET);
+  CU_ASSERT_EQUAL(fread(bytes, 1, 4, file), 4);
+  CU_ASSERT_EQUAL(bytes[0], 0x04);
+  CU_ASSERT_EQUAL(bytes[3], 0x01);
+
+  rewind(file);
+  fputc('X', file);
+  rewind(file);
+  CU_ASSERT_FALSE(readHeatMap(&loaded, file));
+  fclose(file);
+}
+
+void test_heatmap_image() {
+  static byte pixels[MEMORY_SIZE * 3];
+  char header[16] = { 0 };
+
+  clearHeatMap(&heatmap);
+  heatmap.writes[0x0102] = 1000;
+  heatmap.writes[0x0103] = 10;
+  heatmap.reads[0x0000] = 7;
+
+  FILE *file = tmpfile();
+  CU_ASSERT_TRUE(writeHeatMapImage(&heatmap, file));
+  rewind(file);
+  CU_ASSERT_EQUAL(fread(header, 1, 15, file), 15);
+  CU_ASSERT_STRING_EQUAL(header, "P6\n256 256\n255\n");
+  CU_ASSERT_EQUAL(fread(pixels, 1, sizeof(pixels), file), sizeof(pixels));
+  fclose(file);
+
+  // Row 1, column 2: the hottest write is full red
+  CU_ASSERT_EQUAL(pixels[0x0102 * 3], 255);
+  CU_ASSERT_TRUE(pixels[0x0103 * 3] > 0 && pixels[0x0103 * 3] < 255);
+  CU_ASSERT_EQUAL(pixels[0x0102 * 3 + 1], 0);
+  CU_ASSERT_EQUAL(pixels[0x0000 * 3 + 1], 255);
+  CU_ASSERT_EQUAL(pixels[0x0000 * 3 + 2], 0);
+  CU_ASSERT_EQUAL(pixels[0xFFFF * 3], 0);
+}
+
+void run_heatmap_tests() {
+  CU_pSuite suite = CU_add_suite("Heat map tests", 0, 0);
+
+#ifdef MEMORY_HEATMAP
+  CU_add_test(suite, "Counts reads, writes and fetches", test_heatmap_counts_accesses);
+#endif
+  CU_add_test(suite, "Binary file round trip", test_heatmap_file);
+  CU_add_test(suite, "Image", test_heatmap_image);
+}
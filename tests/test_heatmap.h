@@ -0,0 +1,6 @@
+#ifndef TEST_HEATMAP_H
+#define TEST_HEATMAP_H
+
+void run_heatmap_tests();
+
+#endif
@@ -0,0 +1,171 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/jit.h"
+
+static JIT jit;
+
+// Writes a block of loads using every addressing mode, and returns its cycles
+uint writeJITProgram(Memory *memory, word address) {
+  byte program[] = {
+    OP_LDX_IM, 0x04,
+    OP_LDY_IM, 0x80,
+    OP_LDA_ZP, 0x20,
+    OP_LDA_ZPX, 0xFE,
+    OP_LDA_ABSX, 0xFE, 0x30,
+    OP_LDX_ZPY, 0x90,
+    OP_LDY_ABS, 0x02, 0x30,
+    OP_LDA_ABSY, 0x10, 0x00,
+    OP_LDA_IM, 0x00,
+  };
+
+  for(uint i = 0; i < sizeof(program); i++) {
+    writeByte(memory, address + i, program[i]);
+  }
+
+  return 2 + 2 + 3 + 4 + 5 + 4 + 4 + 4 + 2;
+}
+
+// Fills the data the program loads with values derived from seed
+void writeJITData(Memory *memory, byte seed) {
+  for(uint i = 0; i < 0x100; i++) {
+    writeByte(memory, i, (byte)(i * seed));
+    writeByte(memory, 0x3000 + i, (byte)(i + seed));
+    writeByte(memory, 0x3100 + i, (byte)(i ^ seed));
+  }
+}
+
+void test_jit_matches_interpreter() {
+  CPU jitCPU, cpu;
+  Memory jitMemory, memory;
+  reset(&jitCPU, &jitMemory);
+  reset(&cpu, &memory);
+  initJIT(&jit);
+
+  word startingAddress = 0x0200;
+  uint programCycles = writeJITProgram(&jitMemory, startingAddress);
+  writeJITProgram(&memory, startingAddress);
+
+  // Run the block enough times for it to be translated
+  for(int i = 0; i < JIT_HOT_THRESHOLD * 2; i++) {
+    writeJITData(&jitMemory, i);
+    writeJITData(&memory, i);
+    jitCPU.PC = cpu.PC = startingAddress;
+    uint jitCycles = programCycles, cycles = programCycles;
+
+    executeJIT(&jit, &jitCPU, &jitMemory, &jitCycles);
+    execute(&cpu, &memory, &cycles);
+
+    CU_ASSERT_EQUAL(jitCycles, cycles);
+    CU_ASSERT_EQUAL(jitCPU.PC, cpu.PC);
+    CU_ASSERT_EQUAL(jitCPU.A, cpu.A);
+    CU_ASSERT_EQUAL(jitCPU.X, cpu.X);
+    CU_ASSERT_EQUAL(jitCPU.Y, cpu.Y);
+    CU_ASSERT_EQUAL(jitCPU.PS, cpu.PS);
+  }
+
+#ifdef JIT_NATIVE
+  CU_ASSERT_PTR_NOT_NULL(jit.blocks[startingAddress & (JIT_CACHE_SIZE - 1)].code);
+#endif
+  freeJIT(&jit);
+}
+
+void test_jit_self_modifying_code() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+  initJIT(&jit);
+
+  word startingAddress = 0x0200;
+  uint programCycles = writeJITProgram(&memory, startingAddress);
+  writeJITData(&memory, 3);
+
+  for(int i = 0; i < JIT_HOT_THRESHOLD * 2; i++) {
+    cpu.PC = startingAddress;
+    uint cycles = programCycles;
+    executeJIT(&jit, &cpu, &memory, &cycles);
+  }
+  CU_ASSERT_EQUAL(cpu.A, 0x00);
+
+  // Patch the operand of the last LDA #$00
+  writeByte(&memory, startingAddress + 0x14, 0x42);
+  cpu.PC = startingAddress;
+  uint cycles = programCycles;
+  executeJIT(&jit, &cpu, &memory, &cycles);
+
+  CU_ASSERT_EQUAL(cpu.A, 0x42);
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_FALSE(cpu.PS & ZERO_FLAG);
+  freeJIT(&jit);
+}
+
+void test_jit_partial_budget() {
+  CPU jitCPU, cpu;
+  Memory jitMemory, memory;
+  reset(&jitCPU, &jitMemory);
+  reset(&cpu, &memory);
+  initJIT(&jit);
+
+  word startingAddress = 0x0200;
+  uint programCycles = writeJITProgram(&jitMemory, startingAddress);
+  writeJITProgram(&memory, startingAddress);
+  writeJITData(&jitMemory, 5);
+  writeJITData(&memory, 5);
+
+  for(int i = 0; i < JIT_HOT_THRESHOLD * 2; i++) {
+    jitCPU.PC = startingAddress;
+    uint jitCycles = programCycles;
+    executeJIT(&jit, &jitCPU, &jitMemory, &jitCycles);
+  }
+
+  // A budget smaller than the block must stop at the same instruction
+  jitCPU.PC = cpu.PC = startingAddress;
+  uint jitCycles = 11, cycles = 11;
+  executeJIT(&jit, &jitCPU, &jitMemory, &jitCycles);
+  execute(&cpu, &memory, &cycles);
+
+  CU_ASSERT_EQUAL(jitCycles, cycles);
+  CU_ASSERT_EQUAL(jitCPU.PC, cpu.PC);
+  CU_ASSERT_EQUAL(jitCPU.A, cpu.A);
+  freeJIT(&jit);
+}
+
+byte countingRead(void *context, word address) {
+  return (*(byte *)context)++;
+}
+
+void test_jit_device_reads() {
+  byte counter = 0;
+  Device device = { countingRead, NULL, &counter };
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+  mapDevice(&memory, 0xD000, MEMORY_PAGE_SIZE, device);
+  initJIT(&jit);
+
+  word startingAddress = 0x0200;
+  writeByte(&memory, startingAddress, OP_LDA_IM);
+  writeByte(&memory, startingAddress + 0x01, 0x10);
+  writeByte(&memory, startingAddress + 0x02, OP_LDX_ABS);
+  writeWord(&memory, startingAddress + 0x03, 0xD000);
+
+  // Every run must go through the device, even once the block is hot
+  for(int i = 0; i < JIT_HOT_THRESHOLD * 2; i++) {
+    cpu.PC = startingAddress;
+    uint cycles = 6;
+    executeJIT(&jit, &cpu, &memory, &cycles);
+
+    CU_ASSERT_EQUAL(cycles, 0);
+    CU_ASSERT_EQUAL(cpu.A, 0x10);
+    CU_ASSERT_EQUAL(cpu.X, i);
+  }
+  freeJIT(&jit);
+}
+
+void run_jit_tests() {
+  CU_pSuite suite = CU_add_suite("JIT tests", 0, 0);
+
+  CU_add_test(suite, "JIT matches the interpreter", test_jit_matches_interpreter);
+  CU_add_test(suite, "JIT drops blocks on self-modifying code", test_jit_self_modifying_code);
+  CU_add_test(suite, "JIT respects a partial cycle budget", test_jit_partial_budget);
+  CU_add_test(suite, "JIT leaves device reads to the bus", test_jit_device_reads);
+}
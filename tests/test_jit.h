@@ -0,0 +1,6 @@
+#ifndef TEST_JIT_H
+#define TEST_JIT_H
+
+void run_jit_tests();
+
+#endif
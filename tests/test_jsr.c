@@ -0,0 +1,135 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/decode.h"
+#include "../src/jit.h"
+
+static DecodeCache cache;
+static JIT jit;
+
+void test_jsr_pushes_return_address() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+
+  word startingAddress = 0x0200;
+  cpu.PC = startingAddress;
+  cpu.SP = 0xFF;
+  writeByte(&memory, startingAddress, OP_JSR);
+  writeWord(&memory, startingAddress + 0x01, 0x1234);
+
+  uint cycles = 6;
+  execute(&cpu, &memory, &cycles);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(cpu.PC, 0x1234);
+  CU_ASSERT_EQUAL(cpu.SP, 0xFD);
+  // Address of the JSR's last byte, high byte pushed first
+  CU_ASSERT_EQUAL(readByte(&memory, 0x01FF), 0x02);
+  CU_ASSERT_EQUAL(readByte(&memory, 0x01FE), 0x02);
+}
+
+void test_rts_returns_after_jsr() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+
+  word startingAddress = 0x0200;
+  cpu.PC = startingAddress;
+  cpu.SP = 0xFF;
+  writeByte(&memory, startingAddress, OP_JSR);
+  writeWord(&memory, startingAddress + 0x01, 0x0300);
+  writeByte(&memory, startingAddress + 0x03, OP_LDX_IM);
+  writeByte(&memory, startingAddress + 0x04, 0x80);
+  writeByte(&memory, 0x0300, OP_LDA_IM);
+  writeByte(&memory, 0x0301, 0x42);
+  writeByte(&memory, 0x0302, OP_RTS);
+
+  uint cycles = 6 + 2 + 6 + 2;
+  execute(&cpu, &memory, &cycles);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(cpu.A, 0x42);
+  CU_ASSERT_EQUAL(cpu.X, 0x80);
+  CU_ASSERT_EQUAL(cpu.SP, 0xFF);
+  CU_ASSERT_EQUAL(cpu.PC, startingAddress + 0x05);
+  CU_ASSERT_TRUE(cpu.PS & NEGATIVE_FLAG);
+}
+
+void test_rts_wraps_stack() {
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+
+  cpu.PC = 0x0200;
+  cpu.SP = 0xFF;
+  writeByte(&memory, 0x0200, OP_RTS);
+  writeByte(&memory, 0x0100, 0x33);
+  writeByte(&memory, 0x0101, 0x12);
+
+  uint cycles = 6;
+  execute(&cpu, &memory, &cycles);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(cpu.SP, 0x01);
+  CU_ASSERT_EQUAL(cpu.PC, 0x1234);
+}
+
+// Calls the same subroutine enough times for the translators to pick it up
+static uint writeCalls(Memory *memory) {
+  word address = 0x0200;
+  for(int i = 0; i < 20; i++) {
+    writeByte(memory, address++, OP_JSR);
+    writeWord(memory, address, 0x0300);
+    address += 2;
+  }
+  writeByte(memory, 0x0300, OP_LDA_IM);
+  writeByte(memory, 0x0301, 0x42);
+  writeByte(memory, 0x0302, OP_LDX_ZP);
+  writeByte(memory, 0x0303, 0xFE);
+  writeByte(memory, 0x0304, OP_RTS);
+  return 20 * (6 + 2 + 3 + 6);
+}
+
+void test_jsr_in_translators() {
+  CPU cpu, decodedCPU, jitCPU;
+  Memory memory, decodedMemory, jitMemory;
+  reset(&cpu, &memory);
+  reset(&decodedCPU, &decodedMemory);
+  reset(&jitCPU, &jitMemory);
+  cpu.PC = decodedCPU.PC = jitCPU.PC = 0x0200;
+  cpu.SP = decodedCPU.SP = jitCPU.SP = 0xFF;
+
+  uint cycles = writeCalls(&memory);
+  uint decodedCycles = writeCalls(&decodedMemory);
+  uint jitCycles = writeCalls(&jitMemory);
+  initDecodeCache(&cache);
+  initJIT(&jit);
+
+  execute(&cpu, &memory, &cycles);
+  executeDecoded(&cache, &decodedCPU, &decodedMemory, &decodedCycles);
+  executeJIT(&jit, &jitCPU, &jitMemory, &jitCycles);
+  freeJIT(&jit);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(decodedCycles, 0);
+  CU_ASSERT_EQUAL(jitCycles, 0);
+  CU_ASSERT_EQUAL(cpu.PC, 0x0200 + 20 * 3);
+  CU_ASSERT_EQUAL(decodedCPU.PC, cpu.PC);
+  CU_ASSERT_EQUAL(jitCPU.PC, cpu.PC);
+  CU_ASSERT_EQUAL(decodedCPU.SP, 0xFF);
+  CU_ASSERT_EQUAL(jitCPU.SP, 0xFF);
+  CU_ASSERT_EQUAL(decodedCPU.A, 0x42);
+  CU_ASSERT_EQUAL(jitCPU.A, 0x42);
+  // Return addresses land in the stack page, which LDX $FE doesn't see
+  CU_ASSERT_EQUAL(jitCPU.X, cpu.X);
+  CU_ASSERT_EQUAL(jitCPU.PS, cpu.PS);
+}
+
+void run_jsr_tests() {
+  CU_pSuite suite = CU_add_suite("JSR and RTS tests", 0, 0);
+
+  CU_add_test(suite, "JSR pushes the return address", test_jsr_pushes_return_address);
+  CU_add_test(suite, "RTS returns after the JSR", test_rts_returns_after_jsr);
+  CU_add_test(suite, "RTS wraps around the stack page", test_rts_wraps_stack);
+  CU_add_test(suite, "Translators hand JSR and RTS to the interpreter", test_jsr_in_translators);
+}
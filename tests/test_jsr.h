@@ -0,0 +1,6 @@
+#ifndef TEST_JSR_H
+#define TEST_JSR_H
+
+void run_jsr_tests();
+
+#endif
@@ -0,0 +1,128 @@
+#include "CUnit/Basic.h"
+#include <limits.h>
+#include "../src/6502.h"
+#include "../src/debugger.h"
+
+static Machine first, second;
+
+void test_machine_reset() {
+  resetMachine(&first);
+
+  CU_ASSERT_EQUAL(first.cpu.PC, 0xFFFC);
+  CU_ASSERT_EQUAL(first.cpu.PS, (UNUSED_FLAG | IRQ_DISABLE_FLAG));
+  CU_ASSERT_EQUAL(first.memory.data[0x1234], 0x00);
+}
+
+void test_machines_are_independent() {
+  resetMachine(&first);
+  resetMachine(&second);
+
+  word startingAddress = 0x0100;
+  first.cpu.PC = second.cpu.PC = startingAddress;
+  writeByte(&first.memory, startingAddress, OP_LDA_IM);
+  writeByte(&first.memory, startingAddress + 0x01, 0x11);
+  writeByte(&second.memory, startingAddress, OP_LDA_IM);
+  writeByte(&second.memory, startingAddress + 0x01, 0x80);
+
+  uint firstCycles = 2, secondCycles = 2;
+  runMachine(&first, &firstCycles);
+  runMachine(&second, &secondCycles);
+
+  CU_ASSERT_EQUAL(firstCycles, 0);
+  CU_ASSERT_EQUAL(secondCycles, 0);
+  CU_ASSERT_EQUAL(first.cpu.A, 0x11);
+  CU_ASSERT_EQUAL(second.cpu.A, 0x80);
+  CU_ASSERT_FALSE(first.cpu.PS & NEGATIVE_FLAG);
+  CU_ASSERT_TRUE(second.cpu.PS & NEGATIVE_FLAG);
+}
+
+// LDA $1000 everywhere, four cycles and three bytes each
+static void fillWithAbsoluteLoads(Machine *machine) {
+  resetMachine(machine);
+  for(uint address = 0; address + 2 < MEMORY_SIZE; address += 3) {
+    writeByte(&machine->memory, address, OP_LDA_ABS);
+    writeByte(&machine->memory, address + 1, 0x00);
+    writeByte(&machine->memory, address + 2, 0x10);
+  }
+  machine->cpu.PC = 0x0000;
+}
+
+void test_machine_run_until_carries_overshoot() {
+  fillWithAbsoluteLoads(&first);
+  uint64_t clock = 0;
+
+  // The third load ends two cycles past the deadline
+  RunResult result = runUntil(&first, &clock, 10);
+  CU_ASSERT_EQUAL(result.stop, STOP_BUDGET);
+  CU_ASSERT_EQUAL(result.cycles, 12);
+  CU_ASSERT_EQUAL(result.instructions, 3);
+  CU_ASSERT_EQUAL(clock, 12);
+
+  // and the next slice is two cycles shorter
+  result = runUntil(&first, &clock, 20);
+  CU_ASSERT_EQUAL(result.cycles, 8);
+  CU_ASSERT_EQUAL(result.instructions, 2);
+  CU_ASSERT_EQUAL(clock, 20);
+  CU_ASSERT_EQUAL(first.cpu.PC, 5 * 3);
+
+  // A deadline that already passed runs nothing
+  result = runUntil(&first, &clock, 19);
+  CU_ASSERT_EQUAL(result.cycles, 0);
+  CU_ASSERT_EQUAL(result.instructions, 0);
+  CU_ASSERT_EQUAL(clock, 20);
+}
+
+// Many small slices retire the same cycles as one long one
+void test_machine_run_until_slices() {
+  fillWithAbsoluteLoads(&first);
+  fillWithAbsoluteLoads(&second);
+  uint64_t firstClock = 0, secondClock = 0, instructions = 0;
+
+  for(uint64_t deadline = 7; deadline <= 7000; deadline += 7) {
+    instructions += runUntil(&first, &firstClock, deadline).instructions;
+  }
+  RunResult result = runUntil(&second, &secondClock, 7000);
+
+  CU_ASSERT_EQUAL(firstClock, secondClock);
+  CU_ASSERT_EQUAL(instructions, result.instructions);
+  CU_ASSERT_EQUAL(result.instructions, 1750);
+  CU_ASSERT_EQUAL(first.cpu.PC, second.cpu.PC);
+}
+
+void test_machine_large_budget() {
+  static Debugger debugger;
+
+  // Budgets above INT_MAX run, only the top values stand for an overrun
+  CU_ASSERT_TRUE(cyclesLeft(1));
+  CU_ASSERT_TRUE(cyclesLeft((uint)INT_MAX + 1));
+  CU_ASSERT_TRUE(cyclesLeft(3000000000u));
+  CU_ASSERT_TRUE(cyclesLeft((uint)-CYCLES_OVERRUN - 1));
+  CU_ASSERT_FALSE(cyclesLeft(0));
+  CU_ASSERT_FALSE(cyclesLeft((uint)-CYCLES_OVERRUN));
+  CU_ASSERT_FALSE(cyclesLeft((uint)-2));
+
+  // A breakpoint ends the run long before the budget does
+  resetMachine(&first);
+  first.cpu.PC = 0x0200;
+  writeByte(&first.memory, 0x0200, OP_LDA_IM);
+  writeByte(&first.memory, 0x0201, 0x42);
+  attachDebugger(&first.memory, &debugger);
+  setWatch(&debugger, 0x0202, WATCH_EXECUTE);
+
+  uint cycles = 3000000000u;
+  CU_ASSERT_EQUAL(runMachine(&first, &cycles), STOP_BREAKPOINT);
+  CU_ASSERT_EQUAL(first.cpu.A, 0x42);
+  CU_ASSERT_EQUAL(first.cpu.PC, 0x0202);
+  CU_ASSERT_EQUAL(cycles, 3000000000u - 2);
+  detachDebugger(&first.memory);
+}
+
+void run_machine_tests() {
+  CU_pSuite suite = CU_add_suite("Machine tests", 0, 0);
+
+  CU_add_test(suite, "Machine reset", test_machine_reset);
+  CU_add_test(suite, "Machines are independent", test_machines_are_independent);
+  CU_add_test(suite, "Run until carries the overshoot", test_machine_run_until_carries_overshoot);
+  CU_add_test(suite, "Run until in small slices", test_machine_run_until_slices);
+  CU_add_test(suite, "Budgets above INT_MAX run", test_machine_large_budget);
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_MACHINE_H
+#define TEST_MACHINE_H
+
+void run_machine_tests();
+
+#endif
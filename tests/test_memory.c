@@ -26,10 +26,77 @@ void test_word_read_write() {
   CU_ASSERT(readWord(&memory, 0x2345) == 0xBEEF);
 }
 
+// Test for a ROM image mapped over RAM
+void test_rom_mapping() {
+  static byte rom[MEMORY_PAGE_SIZE * 2];
+  Memory memory;
+  initMemory(&memory);
+  rom[0x0000] = 0x11;
+  rom[0x01FF] = 0x22;
+
+  mapROM(&memory, 0xE000, sizeof(rom), rom);
+  writeByte(&memory, 0xE000, 0xAB);
+
+  CU_ASSERT(readByte(&memory, 0xE000) == 0x11);
+  CU_ASSERT(readByte(&memory, 0xE1FF) == 0x22);
+  CU_ASSERT(readByte(&memory, 0xE200) == 0x00);
+  CU_ASSERT(rom[0x0000] == 0x11);
+}
+
+typedef struct {
+  byte lastWrite;
+  word lastAddress;
+  uint reads;
+} TestDevice;
+
+byte testDeviceRead(void *context, word address) {
+  TestDevice *device = context;
+  device->reads++;
+  return address & 0xFF;
+}
+
+void testDeviceWrite(void *context, word address, byte value) {
+  TestDevice *device = context;
+  device->lastAddress = address;
+  device->lastWrite = value;
+}
+
+// Test for a memory-mapped device
+void test_device_mapping() {
+  TestDevice device = { 0 };
+  Device bus = { testDeviceRead, testDeviceWrite, &device };
+  CPU cpu;
+  Memory memory;
+  reset(&cpu, &memory);
+
+  mapDevice(&memory, 0xD000, MEMORY_PAGE_SIZE, bus);
+  writeByte(&memory, 0xD012, 0x34);
+
+  CU_ASSERT(device.lastAddress == 0xD012);
+  CU_ASSERT(device.lastWrite == 0x34);
+  CU_ASSERT(memory.data[0xD012] == 0x00);
+
+  // The CPU reads the device through the bus too
+  cpu.PC = 0x0200;
+  writeByte(&memory, 0x0200, OP_LDA_ABS);
+  writeWord(&memory, 0x0201, 0xD080);
+  uint cycles = 4;
+  execute(&cpu, &memory, &cycles);
+
+  CU_ASSERT(cpu.A == 0x80);
+  CU_ASSERT(device.reads == 1);
+  CU_ASSERT(cycles == 0);
+
+  mapRAM(&memory, 0xD000, MEMORY_PAGE_SIZE);
+  CU_ASSERT(readByte(&memory, 0xD080) == 0x00);
+}
+
 void run_memory_tests() {
   CU_pSuite suite = CU_add_suite("Memory tests", 0, 0);
 
   CU_add_test(suite, "Memory initialization", test_memory_initialization);
   CU_add_test(suite, "Byte read/write", test_byte_read_write);
   CU_add_test(suite, "Word read/write", test_word_read_write);
+  CU_add_test(suite, "ROM mapping", test_rom_mapping);
+  CU_add_test(suite, "Device mapping", test_device_mapping);
 }
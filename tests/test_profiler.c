@@ -0,0 +1,166 @@
+#include "CUnit/Basic.h"
+#include <string.h>
+#include "../src/6502.h"
+#include "../src/debugger.h"
+#include "../src/profiler.h"
+
+static Machine machine;
+static Profiler profiler;
+
+// Writes count LDA #$nn from address, returns the address after them
+static word loadImmediates(word address, uint count) {
+  for(uint i = 0; i < count; i++) {
+    writeByte(&machine.memory, address++, OP_LDA_IM);
+    writeByte(&machine.memory, address++, i);
+  }
+  return address;
+}
+
+static FILE *textFile(const char *text) {
+  FILE *file = tmpfile();
+  fputs(text, file);
+  rewind(file);
+  return file;
+}
+
+static void readBack(FILE *file, char *text, uint size) {
+  memset(text, 0, size);
+  rewind(file);
+  fread(text, 1, size - 1, file);
+  fclose(file);
+}
+
+void test_profiler_samples_every_period() {
+  resetMachine(&machine);
+  initProfiler(&profiler, 4);
+
+  machine.cpu.PC = 0x0200;
+  loadImmediates(0x0200, 8);
+
+  // Budget split over two calls, the countdown carries over
+  uint cycles = 6;
+  executeProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+  CU_ASSERT_EQUAL(cycles, 0);
+  cycles = 10;
+  executeProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+  CU_ASSERT_EQUAL(cycles, 0);
+
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0210);
+  CU_ASSERT_EQUAL(profiler.total, 4);
+  CU_ASSERT_EQUAL(profiler.samples[0x0204], 1);
+  CU_ASSERT_EQUAL(profiler.samples[0x0208], 1);
+  CU_ASSERT_EQUAL(profiler.samples[0x020C], 1);
+  CU_ASSERT_EQUAL(profiler.samples[0x0210], 1);
+  freeProfiler(&profiler);
+}
+
+void test_profiler_carries_overrun() {
+  resetMachine(&machine);
+  initProfiler(&profiler, 3);
+
+  machine.cpu.PC = 0x0200;
+  loadImmediates(0x0200, 3);
+
+  // Slices of 3 cycles end one cycle into each 2-cycle instruction
+  uint cycles = 6;
+  executeProfiled(&profiler, &machine.cpu, &machine.memory, &cycles);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0206);
+  CU_ASSERT_EQUAL(profiler.total, 2);
+  CU_ASSERT_EQUAL(profiler.samples[0x0204], 1);
+  CU_ASSERT_EQUAL(profiler.samples[0x0206], 1);
+  freeProfiler(&profiler);
+}
+
+void test_profiler_stops_at_breakpoints() {
+  static Debugger debugger;
+  resetMachine(&machine);
+  initProfiler(&profiler, 4);
+  attachDebugger(&machine.memory, &debugger);
+  setWatch(&debugger, 0x0206, WATCH_EXECUTE);
+
+  machine.cpu.PC = 0x0200;
+  loadImmediates(0x0200, 8);
+
+  uint cycles = 100;
+  CU_ASSERT_EQUAL(executeProfiled(&profiler, &machine.cpu, &machine.memory, &cycles), STOP_BREAKPOINT);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0206);
+  CU_ASSERT_EQUAL(cycles, 100 - 3 * 2);
+  CU_ASSERT_EQUAL(profiler.total, 1);
+  CU_ASSERT_EQUAL(profiler.countdown, 2);
+
+  // Continuing runs the instruction at the breakpoint, and the countdown
+  // carries over the stop
+  cycles = 2;
+  CU_ASSERT_EQUAL(executeProfiled(&profiler, &machine.cpu, &machine.memory, &cycles), STOP_BUDGET);
+  CU_ASSERT_EQUAL(machine.cpu.PC, 0x0208);
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(profiler.total, 2);
+  CU_ASSERT_EQUAL(profiler.samples[0x0208], 1);
+
+  detachDebugger(&machine.memory);
+  freeProfiler(&profiler);
+}
+
+void test_profiler_symbols() {
+  initProfiler(&profiler, 1);
+
+  FILE *labels = textFile(
+    "al C:0300 .loop\n"
+    "al 0200 .main\n"
+    "garbage\n");
+  CU_ASSERT_EQUAL(loadVICELabels(&profiler.symbols, labels), 2);
+  fclose(labels);
+
+  FILE *debug = textFile(
+    "version\tmajor=2,minor=0\n"
+    "sym\tid=0,name=\"copy\",addrsize=absolute,scope=0,def=1,val=0x0400,seg=0,type=lab\n"
+    "sym\tid=1,name=\"SIZE\",addrsize=zeropage,scope=0,def=2,val=0x10,type=equ\n");
+  CU_ASSERT_EQUAL(loadCA65Symbols(&profiler.symbols, debug), 1);
+  fclose(debug);
+
+  CU_ASSERT_PTR_NULL(findSymbol(&profiler.symbols, 0x01FF));
+  CU_ASSERT_STRING_EQUAL(findSymbol(&profiler.symbols, 0x0200), "main");
+  CU_ASSERT_STRING_EQUAL(findSymbol(&profiler.symbols, 0x02FF), "main");
+  CU_ASSERT_STRING_EQUAL(findSymbol(&profiler.symbols, 0x0300), "loop");
+  CU_ASSERT_STRING_EQUAL(findSymbol(&profiler.symbols, 0xFFFF), "copy");
+  freeProfiler(&profiler);
+}
+
+void test_profiler_reports() {
+  char text[512];
+  initProfiler(&profiler, 1);
+
+  FILE *labels = textFile("al C:0200 .main\nal C:0300 .loop\n");
+  loadVICELabels(&profiler.symbols, labels);
+  fclose(labels);
+
+  profiler.samples[0x0200] = 1;
+  profiler.samples[0x0210] = 2;
+  profiler.samples[0x0305] = 5;
+  profiler.samples[0x0100] = 2;
+  profiler.total = 10;
+
+  FILE *out = tmpfile();
+  writeFoldedStacks(&profiler, out);
+  readBack(out, text, sizeof(text));
+  CU_ASSERT_STRING_EQUAL(text, "loop 5\nmain 3\n$0100 2\n");
+
+  out = tmpfile();
+  writeFlatProfile(&profiler, out);
+  readBack(out, text, sizeof(text));
+  CU_ASSERT_PTR_NOT_NULL(strstr(text, "5   50.00%  loop\n"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(text, "3   30.00%  main\n"));
+  freeProfiler(&profiler);
+}
+
+void run_profiler_tests() {
+  CU_pSuite suite = CU_add_suite("Profiler tests", 0, 0);
+
+  CU_add_test(suite, "Samples every period", test_profiler_samples_every_period);
+  CU_add_test(suite, "Carries the overrun of a slice", test_profiler_carries_overrun);
+  CU_add_test(suite, "Stops at breakpoints", test_profiler_stops_at_breakpoints);
+  CU_add_test(suite, "Loads VICE and ca65 symbols", test_profiler_symbols);
+  CU_add_test(suite, "Flat profile and folded stacks", test_profiler_reports);
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_PROFILER_H
+#define TEST_PROFILER_H
+
+void run_profiler_tests();
+
+#endif
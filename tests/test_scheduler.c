@@ -0,0 +1,181 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/scheduler.h"
+
+static Machine machine, reference;
+static Scheduler scheduler, referenceScheduler;
+
+typedef struct {
+  uint fired;
+  uint64_t clocks[16];
+  uint64_t period; // Reschedules itself when not 0
+  uint *order; // Shared log of which events ran
+  uint id;
+} Timer;
+
+static uint order[16];
+static uint orderCount;
+
+static void tick(Scheduler *scheduler, void *context) {
+  Timer *timer = context;
+  if(timer->fired < 16)
+    timer->clocks[timer->fired] = scheduler->clock;
+  timer->fired++;
+  if(orderCount < 16)
+    order[orderCount++] = timer->id;
+  if(timer->period)
+    scheduleEvent(scheduler, scheduler->clock + timer->period, tick, timer);
+}
+
+// Every byte is LDA #$A9, two cycles each
+static void fillWithLoads() {
+  resetMachine(&machine);
+  for(uint address = 0; address < MEMORY_SIZE; address++) {
+    writeByte(&machine.memory, address, OP_LDA_IM);
+  }
+  initScheduler(&scheduler);
+  orderCount = 0;
+}
+
+void test_scheduler_runs_events_at_deadlines() {
+  fillWithLoads();
+  Timer first = { .id = 1 }, second = { .id = 2 }, third = { .id = 3 };
+  CU_ASSERT_TRUE(scheduleEvent(&scheduler, 101, tick, &second));
+  CU_ASSERT_TRUE(scheduleEvent(&scheduler, 50, tick, &first));
+  CU_ASSERT_TRUE(scheduleEvent(&scheduler, 5000, tick, &third));
+  CU_ASSERT_EQUAL(nextDeadline(&scheduler), 50);
+
+  word startingAddress = machine.cpu.PC;
+  runScheduled(&scheduler, &machine, 1000);
+
+  CU_ASSERT_EQUAL(scheduler.clock, 1000);
+  CU_ASSERT_EQUAL(first.fired, 1);
+  CU_ASSERT_EQUAL(first.clocks[0], 50);
+  // The instruction running at cycle 101 ends on 102
+  CU_ASSERT_EQUAL(second.clocks[0], 102);
+  CU_ASSERT_EQUAL(third.fired, 0);
+  CU_ASSERT_EQUAL(order[0], 1);
+  CU_ASSERT_EQUAL(order[1], 2);
+  CU_ASSERT_EQUAL(nextDeadline(&scheduler), 5000);
+
+  // The overrun is carried into the clock
+  runScheduled(&scheduler, &machine, 4001);
+  CU_ASSERT_EQUAL(third.clocks[0], 5000);
+  CU_ASSERT_EQUAL(scheduler.clock, 5002);
+  CU_ASSERT_EQUAL((word)(machine.cpu.PC - startingAddress), 5002);
+}
+
+void test_scheduler_periodic_events() {
+  fillWithLoads();
+  Timer timer = { .period = 100 };
+  scheduleEvent(&scheduler, 100, tick, &timer);
+
+  runScheduled(&scheduler, &machine, 1000);
+  CU_ASSERT_EQUAL(timer.fired, 10);
+  CU_ASSERT_EQUAL(timer.clocks[9], 1000);
+  CU_ASSERT_EQUAL(nextDeadline(&scheduler), 1100);
+
+  CU_ASSERT_TRUE(cancelEvent(&scheduler, tick, &timer));
+  CU_ASSERT_FALSE(cancelEvent(&scheduler, tick, &timer));
+  CU_ASSERT_EQUAL(nextDeadline(&scheduler), UINT64_MAX);
+  runScheduled(&scheduler, &machine, 1000);
+  CU_ASSERT_EQUAL(timer.fired, 10);
+  CU_ASSERT_EQUAL(scheduler.clock, 2000);
+}
+
+void test_scheduler_same_deadline_in_order() {
+  fillWithLoads();
+  Timer timers[SCHEDULER_MAX_EVENTS];
+  for(uint i = 0; i < SCHEDULER_MAX_EVENTS; i++) {
+    timers[i] = (Timer){ .id = i };
+    CU_ASSERT_TRUE(scheduleEvent(&scheduler, i < 8 ? 20 : 40, tick, &timers[i]));
+  }
+  CU_ASSERT_FALSE(scheduleEvent(&scheduler, 10, tick, &timers[0]));
+
+  // Cancelling takes the earliest event of a handler and context
+  CU_ASSERT_TRUE(cancelEvent(&scheduler, tick, &timers[3]));
+
+  runScheduled(&scheduler, &machine, 20);
+  CU_ASSERT_EQUAL(orderCount, 7);
+  uint expected[] = { 0, 1, 2, 4, 5, 6, 7 };
+  for(uint i = 0; i < 7; i++) {
+    CU_ASSERT_EQUAL(order[i], expected[i]);
+  }
+  CU_ASSERT_EQUAL(scheduler.count, SCHEDULER_MAX_EVENTS - 8);
+}
+
+void test_scheduler_due_events_run_first() {
+  fillWithLoads();
+  Timer timer = { .id = 1 };
+  scheduler.clock = 300;
+  scheduleEvent(&scheduler, 200, tick, &timer);
+
+  // Nothing runs before an overdue event
+  runScheduled(&scheduler, &machine, 10);
+  CU_ASSERT_EQUAL(timer.clocks[0], 300);
+  CU_ASSERT_EQUAL(scheduler.clock, 310);
+}
+
+// Without branches the only loop is PC wrapping around memory: 32768 loads
+// of two cycles
+void test_scheduler_skips_idle_loops() {
+  fillWithLoads();
+  // Already in the loop, so the probe finds it
+  machine.cpu.A = OP_LDA_IM;
+  setPS(&machine.cpu, &machine.cpu.A, ZERO_FLAG | NEGATIVE_FLAG);
+  reference = machine;
+  initScheduler(&referenceScheduler);
+  Timer timer = { .id = 1 }, referenceTimer = { .id = 2 };
+  scheduleEvent(&scheduler, 1000000, tick, &timer);
+  scheduleEvent(&referenceScheduler, 1000000, tick, &referenceTimer);
+
+  // Skips whole turns up to the deadline, and nothing without one
+  uint64_t skipped = skipIdle(&scheduler, &machine, 40000);
+  CU_ASSERT_TRUE(skipped > 1000000 - 2 * 65536);
+  CU_ASSERT_TRUE(scheduler.clock <= 1000000);
+  CU_ASSERT_EQUAL(timer.fired, 0);
+  runScheduled(&scheduler, &machine, 3000000 - scheduler.clock);
+  CU_ASSERT_EQUAL(skipIdle(&scheduler, &machine, 40000), 0);
+  runScheduled(&referenceScheduler, &reference, 3000000);
+
+  CU_ASSERT_EQUAL(timer.fired, 1);
+  CU_ASSERT_EQUAL(timer.clocks[0], 1000000);
+  CU_ASSERT_EQUAL(referenceTimer.clocks[0], 1000000);
+  CU_ASSERT_EQUAL(scheduler.clock, 3000000);
+  CU_ASSERT_EQUAL(machine.cpu.PC, reference.cpu.PC);
+  CU_ASSERT_EQUAL(machine.cpu.A, reference.cpu.A);
+  CU_ASSERT_EQUAL(scheduler.clock, referenceScheduler.clock);
+}
+
+void test_scheduler_stores_keep_loops_running() {
+  fillWithLoads();
+  machine.cpu.PC = 0x0000;
+  machine.cpu.SP = 0xFE;
+  Timer timer = { .id = 1 };
+  scheduleEvent(&scheduler, 1000000, tick, &timer);
+
+  // Two calls per turn keep the loads on even addresses, where the pushed
+  // return addresses put $A9 too
+  writeByte(&machine.memory, 0xA900, OP_JSR);
+  writeWord(&machine.memory, 0xA901, 0x41A9);
+  writeByte(&machine.memory, 0xA903, OP_JSR);
+  writeWord(&machine.memory, 0xA904, 0x41A9);
+  writeByte(&machine.memory, 0x41A9, OP_RTS);
+
+  CU_ASSERT_EQUAL(skipIdle(&scheduler, &machine, 40000), 0);
+  runScheduled(&scheduler, &machine, 1000000 - scheduler.clock);
+  CU_ASSERT_EQUAL(scheduler.clock, 1000000);
+  CU_ASSERT_EQUAL(timer.fired, 1);
+  CU_ASSERT_EQUAL(machine.cpu.SP, 0xFE);
+}
+
+void run_scheduler_tests() {
+  CU_pSuite suite = CU_add_suite("Scheduler tests", 0, 0);
+
+  CU_add_test(suite, "Runs events at their deadlines", test_scheduler_runs_events_at_deadlines);
+  CU_add_test(suite, "Periodic and cancelled events", test_scheduler_periodic_events);
+  CU_add_test(suite, "Same deadline in scheduling order", test_scheduler_same_deadline_in_order);
+  CU_add_test(suite, "Overdue events run first", test_scheduler_due_events_run_first);
+  CU_add_test(suite, "Skips idle loops", test_scheduler_skips_idle_loops);
+  CU_add_test(suite, "Loops that store aren't skipped", test_scheduler_stores_keep_loops_running);
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_SCHEDULER_H
+#define TEST_SCHEDULER_H
+
+void run_scheduler_tests();
+
+#endif
@@ -0,0 +1,91 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/snapshot.h"
+
+static Machine machine;
+static Snapshot snapshot;
+
+void test_snapshot_restore() {
+  resetMachine(&machine);
+
+  word startingAddress = 0x0200;
+  machine.cpu.PC = startingAddress;
+  writeByte(&machine.memory, startingAddress, OP_LDA_ZP);
+  writeByte(&machine.memory, startingAddress + 0x01, 0x10);
+  writeByte(&machine.memory, 0x0010, 0x33);
+
+  takeSnapshot(&snapshot, &machine);
+  CU_ASSERT_FALSE(pageWritten(&snapshot, &machine, 0x00));
+
+  writeByte(&machine.memory, 0x0010, 0x44);
+  writeByte(&machine.memory, 0x8000, 0x55);
+  uint cycles = 3;
+  runMachine(&machine, &cycles);
+  CU_ASSERT_EQUAL(machine.cpu.A, 0x44);
+  CU_ASSERT_TRUE(pageWritten(&snapshot, &machine, 0x00));
+  CU_ASSERT_TRUE(pageWritten(&snapshot, &machine, 0x80));
+  CU_ASSERT_FALSE(pageWritten(&snapshot, &machine, 0x02));
+
+  restoreSnapshot(&snapshot, &machine);
+
+  CU_ASSERT_EQUAL(machine.cpu.PC, startingAddress);
+  CU_ASSERT_EQUAL(machine.cpu.A, 0x00);
+  CU_ASSERT_EQUAL(readByte(&machine.memory, 0x0010), 0x33);
+  CU_ASSERT_EQUAL(readByte(&machine.memory, 0x8000), 0x00);
+  CU_ASSERT_FALSE(pageWritten(&snapshot, &machine, 0x00));
+  CU_ASSERT_FALSE(pageWritten(&snapshot, &machine, 0x80));
+
+  // The same snapshot can be restored again
+  cycles = 3;
+  runMachine(&machine, &cycles);
+  CU_ASSERT_EQUAL(machine.cpu.A, 0x33);
+  writeByte(&machine.memory, 0x0010, 0x66);
+  restoreSnapshot(&snapshot, &machine);
+  CU_ASSERT_EQUAL(readByte(&machine.memory, 0x0010), 0x33);
+}
+
+void test_snapshot_ignores_rom_writes() {
+  static byte rom[MEMORY_PAGE_SIZE];
+  resetMachine(&machine);
+  mapROM(&machine.memory, 0xF000, sizeof(rom), rom);
+
+  takeSnapshot(&snapshot, &machine);
+  writeByte(&machine.memory, 0xF000, 0x12);
+
+  CU_ASSERT_FALSE(pageWritten(&snapshot, &machine, 0xF0));
+}
+
+void test_snapshot_several() {
+  static Snapshot older;
+  resetMachine(&machine);
+
+  writeByte(&machine.memory, 0x0010, 0x01);
+  takeSnapshot(&older, &machine);
+  writeByte(&machine.memory, 0x0010, 0x02);
+  takeSnapshot(&snapshot, &machine);
+  writeByte(&machine.memory, 0x2000, 0x03);
+
+  // $0010 was written after the older snapshot, before the newer one
+  CU_ASSERT_TRUE(pageWritten(&older, &machine, 0x00));
+  CU_ASSERT_FALSE(pageWritten(&snapshot, &machine, 0x00));
+
+  restoreSnapshot(&older, &machine);
+  CU_ASSERT_EQUAL(readByte(&machine.memory, 0x0010), 0x01);
+  CU_ASSERT_EQUAL(readByte(&machine.memory, 0x2000), 0x00);
+
+  // Back to the newer one, whose pages the first restore changed
+  restoreSnapshot(&snapshot, &machine);
+  CU_ASSERT_EQUAL(readByte(&machine.memory, 0x0010), 0x02);
+  CU_ASSERT_EQUAL(readByte(&machine.memory, 0x2000), 0x00);
+
+  restoreSnapshot(&older, &machine);
+  CU_ASSERT_EQUAL(readByte(&machine.memory, 0x0010), 0x01);
+}
+
+void run_snapshot_tests() {
+  CU_pSuite suite = CU_add_suite("Snapshot tests", 0, 0);
+
+  CU_add_test(suite, "Snapshot and restore", test_snapshot_restore);
+  CU_add_test(suite, "ROM writes don't dirty pages", test_snapshot_ignores_rom_writes);
+  CU_add_test(suite, "Several snapshots restored in any order", test_snapshot_several);
+}
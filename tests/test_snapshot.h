@@ -0,0 +1,6 @@
+#ifndef TEST_SNAPSHOT_H
+#define TEST_SNAPSHOT_H
+
+void run_snapshot_tests();
+
+#endif
@@ -0,0 +1,105 @@
+#include "CUnit/Basic.h"
+#include <string.h>
+#include "../src/6502.h"
+#include "../src/stats.h"
+
+// Only built with -DOPCODE_STATS, there is nothing to test otherwise
+
+#ifdef OPCODE_STATS
+
+static Machine machine;
+
+void test_stats_count_opcodes() {
+  resetMachine(&machine);
+  resetOpcodeStats();
+
+  word startingAddress = 0x0200;
+  machine.cpu.PC = startingAddress;
+  machine.cpu.X = 0x01;
+  writeByte(&machine.memory, startingAddress, OP_LDA_IM);
+  writeByte(&machine.memory, startingAddress + 0x01, 0x11);
+  writeByte(&machine.memory, startingAddress + 0x02, OP_LDA_IM);
+  writeByte(&machine.memory, startingAddress + 0x03, 0x22);
+  writeByte(&machine.memory, startingAddress + 0x04, OP_LDX_ABS);
+  writeWord(&machine.memory, startingAddress + 0x05, 0x0300);
+  writeByte(&machine.memory, startingAddress + 0x07, OP_LDA_ABSX);
+  writeWord(&machine.memory, startingAddress + 0x08, 0x0300);
+
+  uint cycles = 2 + 2 + 4 + 5;
+  runMachine(&machine, &cycles);
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(opcodeStats[OP_LDA_IM].count, 2);
+  CU_ASSERT_EQUAL(opcodeStats[OP_LDA_IM].cycles, 4);
+  CU_ASSERT_EQUAL(opcodeStats[OP_LDX_ABS].count, 1);
+  CU_ASSERT_EQUAL(opcodeStats[OP_LDX_ABS].cycles, 4);
+  CU_ASSERT_EQUAL(opcodeStats[OP_LDA_ABSX].count, 1);
+  CU_ASSERT_EQUAL(opcodeStats[OP_LDA_ABSX].cycles, 5);
+  CU_ASSERT_EQUAL(opcodeStats[OP_LDY_IM].count, 0);
+
+  CU_ASSERT_EQUAL(opcodePairs[OP_LDA_IM][OP_LDA_IM], 1);
+  CU_ASSERT_EQUAL(opcodePairs[OP_LDA_IM][OP_LDX_ABS], 1);
+  CU_ASSERT_EQUAL(opcodePairs[OP_LDX_ABS][OP_LDA_ABSX], 1);
+  CU_ASSERT_EQUAL(opcodePairs[OP_LDA_ABSX][OP_LDA_IM], 0);
+
+  OpcodeCounter modes[ADDRESSING_MODES];
+  getModeStats(modes);
+  CU_ASSERT_EQUAL(modes[MODE_IM].count, 2);
+  CU_ASSERT_EQUAL(modes[MODE_IM].cycles, 4);
+  CU_ASSERT_EQUAL(modes[MODE_ABS].count, 1);
+  CU_ASSERT_EQUAL(modes[MODE_ABSX].cycles, 5);
+  CU_ASSERT_EQUAL(modes[MODE_ZP].count, 0);
+}
+
+void test_stats_report() {
+  char report[4096] = { 0 };
+  FILE *out = tmpfile();
+  printOpcodeStats(out);
+  rewind(out);
+  fread(report, 1, sizeof(report) - 1, out);
+  fclose(out);
+
+  // Opcodes are sorted by host time, which is unpredictable, so only check
+  // that every executed opcode and mode is listed
+  CU_ASSERT_PTR_NOT_NULL(strstr(report, "LDA_IM"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(report, "LDX_ABS"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(report, "LDA_ABSX"));
+  CU_ASSERT_PTR_NULL(strstr(report, "LDY_IM"));
+  CU_ASSERT_PTR_NOT_NULL(strstr(report, "ABSX "));
+}
+
+void test_stats_pair_profile() {
+  static uint64_t pairs[256][256];
+  memset(pairs, 0, sizeof(pairs));
+
+  FILE *file = tmpfile();
+  CU_ASSERT_TRUE(writeOpcodePairs(opcodePairs, file));
+  rewind(file);
+  CU_ASSERT_TRUE(readOpcodePairs(pairs, file));
+  rewind(file);
+  CU_ASSERT_TRUE(readOpcodePairs(pairs, file));
+  fclose(file);
+
+  // Reading adds up
+  CU_ASSERT_EQUAL(pairs[OP_LDA_IM][OP_LDX_ABS], 2 * opcodePairs[OP_LDA_IM][OP_LDX_ABS]);
+  CU_ASSERT_EQUAL(pairs[OP_LDX_ABS][OP_LDA_ABSX], 2);
+  CU_ASSERT_EQUAL(pairs[OP_LDA_ABSX][OP_LDA_IM], 0);
+
+  file = tmpfile();
+  fputs("A9 A9 3\nnot a pair\n", file);
+  rewind(file);
+  CU_ASSERT_FALSE(readOpcodePairs(pairs, file));
+  fclose(file);
+}
+
+#endif
+
+void run_stats_tests() {
+#ifdef OPCODE_STATS
+  CU_pSuite suite = CU_add_suite("Opcode statistics tests", 0, 0);
+
+  CU_add_test(suite, "Count opcodes and modes", test_stats_count_opcodes);
+  CU_add_test(suite, "Report executed opcodes", test_stats_report);
+  CU_add_test(suite, "Write and merge pair profiles", test_stats_pair_profile);
+#endif
+}
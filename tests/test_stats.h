@@ -0,0 +1,6 @@
+#ifndef TEST_STATS_H
+#define TEST_STATS_H
+
+void run_stats_tests();
+
+#endif
@@ -0,0 +1,151 @@
+#include "CUnit/Basic.h"
+#include <string.h>
+#include "../src/6502.h"
+#include "../src/trace.h"
+
+static Tracer tracer;
+static char text[4096];
+
+// Decodes a finished trace file into text
+static byte decodeInto(FILE *file) {
+  FILE *out = tmpfile();
+  rewind(file);
+  byte ok = decodeTrace(file, out);
+  long length = ftell(out);
+  rewind(out);
+  memset(text, 0, sizeof(text));
+  if(fread(text, 1, length, out) != (size_t)length)
+    ok = 0;
+  fclose(out);
+  return ok;
+}
+
+void test_trace_varint() {
+  byte buffer[4];
+
+  CU_ASSERT_EQUAL(traceVarint(buffer, 0) - buffer, 1);
+  CU_ASSERT_EQUAL(buffer[0], 0x00);
+  CU_ASSERT_EQUAL(traceVarint(buffer, -1) - buffer, 1);
+  CU_ASSERT_EQUAL(buffer[0], 0x01);
+  CU_ASSERT_EQUAL(traceVarint(buffer, 2) - buffer, 1);
+  CU_ASSERT_EQUAL(buffer[0], 0x04);
+  CU_ASSERT_EQUAL(traceVarint(buffer, 64) - buffer, 2);
+  CU_ASSERT_EQUAL(buffer[0], 0x80);
+  CU_ASSERT_EQUAL(buffer[1], 0x01);
+  CU_ASSERT_EQUAL(traceVarint(buffer, -32768) - buffer, 3);
+  CU_ASSERT_EQUAL(buffer[2], 0x03);
+}
+
+void test_trace_round_trip() {
+  CPU cpu;
+  resetCPU(&cpu);
+  cpu.PC = 0x0200;
+  cpu.SP = 0xFF;
+
+  FILE *file = tmpfile();
+  CU_ASSERT_TRUE_FATAL(startTrace(&tracer, file));
+  traceSync(&tracer, &cpu);
+
+  // LDA #$80, only A and PS change
+  cpu.A = 0x80;
+  cpu.PC = 0x0202;
+  cpu.result = 0x80;
+  cpu.lazyFlags = 1;
+  traceInstruction(&tracer, &cpu, OP_LDA_IM, 0x0200);
+
+  // LDX $10 reads address 0x0010
+  traceAccess(&tracer, 0x0010);
+  cpu.X = 0x01;
+  cpu.PC = 0x0204;
+  cpu.result = 0x01;
+  traceInstruction(&tracer, &cpu, OP_LDX_ZP, 0x0202);
+
+  // JSR $0300 pushes to the stack and jumps
+  traceAccess(&tracer, 0x01FE);
+  cpu.SP = 0xFD;
+  cpu.PC = 0x0300;
+  traceInstruction(&tracer, &cpu, OP_JSR, 0x0204);
+
+  CU_ASSERT_TRUE(stopTrace(&tracer));
+  CU_ASSERT_EQUAL(tracer.records, 3);
+  // Header, sync, then 4, 5 and 7 bytes of records
+  CU_ASSERT_EQUAL(ftell(file), 8 + 8 + 4 + 5 + 7);
+
+  CU_ASSERT_TRUE(decodeInto(file));
+  CU_ASSERT_STRING_EQUAL(text,
+    "---- sync PC=0200 A=00 X=00 Y=00 SP=FF PS=24\n"
+    "0200  A9 LDA_IM   A=80 X=00 Y=00 SP=FF PS=A4\n"
+    "0202  A6 LDX_ZP   A=80 X=01 Y=00 SP=FF PS=24  [0010]\n"
+    "0204  20 JSR      A=80 X=01 Y=00 SP=FD PS=24  [01FE]\n");
+  fclose(file);
+}
+
+void test_trace_rejects_bad_files() {
+  FILE *file = tmpfile();
+  fputs("C6502TR0", file);
+  CU_ASSERT_FALSE(decodeInto(file));
+  fclose(file);
+
+  // A record cut short
+  file = tmpfile();
+  fputs("C6502TR1", file);
+  fputc(TRACE_A, file);
+  fputc(OP_LDA_IM, file);
+  CU_ASSERT_FALSE(decodeInto(file));
+  fclose(file);
+}
+
+#ifdef EXECUTION_TRACE
+
+static Machine machine;
+
+void test_trace_execute() {
+  resetMachine(&machine);
+
+  word startingAddress = 0x0200;
+  machine.cpu.PC = startingAddress;
+  machine.cpu.SP = 0xFF;
+  writeByte(&machine.memory, 0x0010, 0x42);
+  writeByte(&machine.memory, startingAddress, OP_LDA_ZP);
+  writeByte(&machine.memory, startingAddress + 0x01, 0x10);
+  writeByte(&machine.memory, startingAddress + 0x02, OP_JSR);
+  writeWord(&machine.memory, startingAddress + 0x03, 0x0300);
+  writeByte(&machine.memory, 0x0300, OP_LDY_IM);
+  writeByte(&machine.memory, 0x0301, 0x00);
+  writeByte(&machine.memory, 0x0302, OP_RTS);
+
+  FILE *file = tmpfile();
+  CU_ASSERT_TRUE_FATAL(startTrace(&tracer, file));
+  attachTracer(&machine.memory, &tracer);
+  uint cycles = 3 + 6 + 2 + 6;
+  execute(&machine.cpu, &machine.memory, &cycles);
+  CU_ASSERT_TRUE(stopTrace(&tracer));
+
+  CU_ASSERT_EQUAL(cycles, 0);
+  CU_ASSERT_EQUAL(tracer.records, 4);
+  CU_ASSERT_TRUE(decodeInto(file));
+  CU_ASSERT_STRING_EQUAL(text,
+    "---- sync PC=0200 A=00 X=00 Y=00 SP=FF PS=24\n"
+    "0200  A5 LDA_ZP   A=42 X=00 Y=00 SP=FF PS=24  [0010]\n"
+    "0202  20 JSR      A=42 X=00 Y=00 SP=FD PS=24  [01FE]\n"
+    "0300  A0 LDY_IM   A=42 X=00 Y=00 SP=FD PS=26\n"
+    "0302  60 RTS      A=42 X=00 Y=00 SP=FF PS=26  [01FF]\n");
+  fclose(file);
+
+  // Reset detaches the tracer
+  resetMachine(&machine);
+  CU_ASSERT_PTR_NULL(machine.memory.tracer);
+}
+
+#endif
+
+void run_trace_tests() {
+  CU_pSuite suite = CU_add_suite("Execution trace tests", 0, 0);
+
+  CU_add_test(suite, "Zigzag varints", test_trace_varint);
+  CU_add_test(suite, "Decodes what was recorded", test_trace_round_trip);
+  CU_add_test(suite, "Rejects bad files", test_trace_rejects_bad_files);
+#ifdef EXECUTION_TRACE
+  CU_add_test(suite, "Traces execute()", test_trace_execute);
+#endif
+}
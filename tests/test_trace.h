@@ -0,0 +1,6 @@
+#ifndef TEST_TRACE_H
+#define TEST_TRACE_H
+
+void run_trace_tests();
+
+#endif
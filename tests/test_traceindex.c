@@ -0,0 +1,213 @@
+#include "CUnit/Basic.h"
+#include "../src/6502.h"
+#include "../src/traceindex.h"
+
+#define INDEX_TEST_RECORDS (3 * TRACE_CHUNK_RECORDS)
+
+static Tracer tracer;
+
+typedef struct {
+  uint64_t records;
+  uint64_t cycles[16];
+} Visits;
+
+static void collect(const TraceState *state, void *context) {
+  Visits *visits = context;
+  if(visits->records < 16)
+    visits->cycles[visits->records] = state->cycles;
+  visits->records++;
+}
+
+// What the queries should find in the test trace
+typedef struct {
+  uint64_t cycles;
+  uint readsOf10;
+  uint runsOf0202;
+  uint64_t callCycles; // After the first JSR
+  uint64_t stateCycles; // After record 5000
+  byte stateA;
+} IndexExpectations;
+
+// Records a loop of zero page loads, calling $0300 every thousand records
+static void writeIndexTrace(FILE *file, IndexExpectations *expected) {
+  CPU cpu;
+  resetCPU(&cpu);
+  cpu.PC = 0x0200;
+  cpu.SP = 0xFF;
+  uint64_t cycles = 0;
+  word returnPC = 0;
+
+  startTrace(&tracer, file);
+  traceSync(&tracer, &cpu);
+  for(uint i = 0; i < INDEX_TEST_RECORDS; i++) {
+    word PC = cpu.PC;
+    byte opcode;
+    if(i % 1000 == 500) {
+      opcode = OP_JSR;
+      traceAccess(&tracer, 0x01FE);
+      returnPC = PC + 3;
+      cpu.SP = 0xFD;
+      cpu.PC = 0x0300;
+      cycles += 6;
+      if(i == 500)
+        expected->callCycles = cycles;
+    } else if(i % 1000 == 501) {
+      opcode = OP_RTS;
+      traceAccess(&tracer, 0x01FF);
+      cpu.SP = 0xFF;
+      cpu.PC = returnPC;
+      cycles += 6;
+    } else {
+      opcode = OP_LDA_ZP;
+      traceAccess(&tracer, i & 0xFF);
+      if((i & 0xFF) == 0x10)
+        expected->readsOf10++;
+      if(PC == 0x0202)
+        expected->runsOf0202++;
+      cpu.A = i;
+      cpu.PC = PC + 2 < 0x0280 ? PC + 2 : 0x0200;
+      cycles += 3;
+    }
+    traceInstruction(&tracer, &cpu, opcode, PC);
+
+    if(i == 5000) {
+      expected->stateCycles = cycles;
+      expected->stateA = cpu.A;
+    }
+  }
+  stopTrace(&tracer);
+  expected->cycles = cycles;
+}
+
+void test_traceindex_queries() {
+  FILE *trace = tmpfile(), *file = tmpfile();
+  IndexExpectations expected = { 0 };
+  writeIndexTrace(trace, &expected);
+
+  CU_ASSERT_TRUE(buildTraceIndex(trace, file));
+  TraceIndex index;
+  CU_ASSERT_TRUE_FATAL(openTraceIndex(&index, trace, file));
+  // The sync record pushes the last instruction into a fourth chunk
+  CU_ASSERT_EQUAL(index.header->chunks, 4);
+
+  Visits visits = { 0 };
+  CU_ASSERT_EQUAL(findWrites(&index, 0x01FE, collect, &visits), 12);
+  CU_ASSERT_EQUAL(visits.records, 12);
+  CU_ASSERT_EQUAL(visits.cycles[0], expected.callCycles);
+  CU_ASSERT_EQUAL(findWrites(&index, 0x01FF, NULL, NULL), 12);
+  CU_ASSERT_EQUAL(findReads(&index, 0x01FF, NULL, NULL), 12);
+  CU_ASSERT_EQUAL(findReads(&index, 0x0010, NULL, NULL), expected.readsOf10);
+  CU_ASSERT_EQUAL(findWrites(&index, 0x0010, NULL, NULL), 0);
+  CU_ASSERT_EQUAL(findReads(&index, 0x1234, NULL, NULL), 0);
+
+  visits.records = 0;
+  CU_ASSERT_EQUAL(findExecutions(&index, 0x0300, collect, &visits), 12);
+  CU_ASSERT_EQUAL(visits.cycles[0], expected.callCycles + 6);
+  CU_ASSERT_EQUAL(findExecutions(&index, 0x0202, NULL, NULL), expected.runsOf0202);
+
+  TraceState state;
+  CU_ASSERT_TRUE(findState(&index, expected.stateCycles, &state));
+  CU_ASSERT_EQUAL(state.records, 5001);
+  CU_ASSERT_EQUAL(state.cycles, expected.stateCycles);
+  CU_ASSERT_EQUAL(state.cpu.A, expected.stateA);
+  CU_ASSERT_TRUE(findState(&index, expected.stateCycles + 1, &state));
+  CU_ASSERT_EQUAL(state.records, 5001);
+  CU_ASSERT_TRUE(findState(&index, 0, &state));
+  CU_ASSERT_EQUAL(state.records, 0);
+  CU_ASSERT_EQUAL(state.cpu.PC, 0x0200);
+  CU_ASSERT_TRUE(findState(&index, expected.cycles * 2, &state));
+  CU_ASSERT_EQUAL(state.records, INDEX_TEST_RECORDS);
+  CU_ASSERT_EQUAL(state.cycles, expected.cycles);
+
+  closeTraceIndex(&index);
+  fclose(file);
+  fclose(trace);
+}
+
+void test_traceindex_rejects_mismatches() {
+  FILE *trace = tmpfile(), *other = tmpfile(), *file = tmpfile();
+  CPU cpu;
+  resetCPU(&cpu);
+
+  startTrace(&tracer, trace);
+  traceSync(&tracer, &cpu);
+  stopTrace(&tracer);
+  startTrace(&tracer, other);
+  traceSync(&tracer, &cpu);
+  traceSync(&tracer, &cpu);
+  stopTrace(&tracer);
+
+  CU_ASSERT_TRUE(buildTraceIndex(trace, file));
+  TraceIndex index;
+  CU_ASSERT_FALSE(openTraceIndex(&index, other, file));
+  CU_ASSERT_FALSE(buildTraceIndex(file, other));
+
+  // A record cut short
+  fputc(TRACE_A, trace);
+  rewind(file);
+  CU_ASSERT_FALSE(buildTraceIndex(trace, file));
+
+  fclose(file);
+  fclose(other);
+  fclose(trace);
+}
+
+#ifdef EXECUTION_TRACE
+
+static Machine machine;
+
+void test_traceindex_cycles_match_execute() {
+  resetMachine(&machine);
+
+  word startingAddress = 0x0200;
+  machine.cpu.PC = startingAddress;
+  machine.cpu.SP = 0xFF;
+  machine.cpu.X = 0x10;
+  writeByte(&machine.memory, startingAddress, OP_LDA_ABSX);
+  writeWord(&machine.memory, startingAddress + 0x01, 0x00F8);
+  writeByte(&machine.memory, startingAddress + 0x03, OP_LDY_ABSX);
+  writeWord(&machine.memory, startingAddress + 0x04, 0x0010);
+  writeByte(&machine.memory, startingAddress + 0x06, OP_JSR);
+  writeWord(&machine.memory, startingAddress + 0x07, 0x0300);
+  writeByte(&machine.memory, 0x0300, OP_RTS);
+  writeByte(&machine.memory, startingAddress + 0x09, OP_LDX_ZPY);
+  writeByte(&machine.memory, startingAddress + 0x0A, 0x80);
+
+  FILE *trace = tmpfile(), *file = tmpfile();
+  startTrace(&tracer, trace);
+  attachTracer(&machine.memory, &tracer);
+  uint cycles = 5 + 4 + 6 + 6 + 4;
+  execute(&machine.cpu, &machine.memory, &cycles);
+  stopTrace(&tracer);
+  CU_ASSERT_EQUAL(cycles, 0);
+
+  TraceIndex index;
+  CU_ASSERT_TRUE(buildTraceIndex(trace, file));
+  CU_ASSERT_TRUE_FATAL(openTraceIndex(&index, trace, file));
+  TraceState state;
+  CU_ASSERT_TRUE(findState(&index, 100, &state));
+  CU_ASSERT_EQUAL(state.cycles, 5 + 4 + 6 + 6 + 4);
+  CU_ASSERT_EQUAL(state.records, 5);
+  CU_ASSERT_EQUAL(state.cpu.PC, machine.cpu.PC);
+  CU_ASSERT_TRUE(findState(&index, 5 + 4 + 6, &state));
+  CU_ASSERT_EQUAL(state.cpu.PC, 0x0300);
+  CU_ASSERT_EQUAL(state.cpu.SP, 0xFD);
+  CU_ASSERT_EQUAL(findWrites(&index, 0x01FF, NULL, NULL), 1);
+  CU_ASSERT_EQUAL(findReads(&index, 0x0108, NULL, NULL), 1);
+
+  closeTraceIndex(&index);
+  fclose(file);
+  fclose(trace);
+}
+
+#endif
+
+void run_traceindex_tests() {
+  CU_pSuite suite = CU_add_suite("Trace index tests", 0, 0);
+
+  CU_add_test(suite, "Writes, reads, executions and states", test_traceindex_queries);
+  CU_add_test(suite, "Rejects mismatched and truncated traces", test_traceindex_rejects_mismatches);
+#ifdef EXECUTION_TRACE
+  CU_add_test(suite, "Cycles match execute()", test_traceindex_cycles_match_execute);
+#endif
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_TRACEINDEX_H
+#define TEST_TRACEINDEX_H
+
+void run_traceindex_tests();
+
+#endif
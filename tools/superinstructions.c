@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include "../src/stats.h"
+
+/*
+ * Chooses the superinstructions from opcode pair profiles and writes them
+ * as src/superinstructions.h: superinstructions HEADER PAIRS...
+ *
+ * The profiles should come from real programs: synthetic loops repeat one
+ * pair over and over, and the pairs they pick don't carry over. Profiles
+ * are summed. Pairs of instructions the decode cache can't run are
+ * skipped, and of the rest the most frequent ones are taken, up to
+ * FUSED_MAX of them and while each still has FUSED_MIN_SHARE of all pairs.
+ */
+
+#define FUSED_MAX 32
+#define FUSED_MIN_SHARE 0.001
+
+static const char * const names[256] = {
+#define NAME(name, mode, reg) [OP_##name] = #name,
+  INSTRUCTIONS(NAME)
+};
+
+static uint64_t pairs[256][256];
+
+typedef struct {
+  byte first, second;
+  uint64_t count;
+} Pair;
+
+// Most frequent first, ties in opcode order so the output is stable
+static int comparePairs(const void *a, const void *b) {
+  const Pair *left = a, *right = b;
+  if(left->count != right->count)
+    return left->count < right->count ? 1 : -1;
+  return (left->first << 8 | left->second) - (right->first << 8 | right->second);
+}
+
+static byte writeHeader(FILE *out, const Pair *fused, uint count, uint64_t total) {
+  fprintf(out,
+    "#ifndef C6502_SUPERINSTRUCTIONS_H\n"
+    "#define C6502_SUPERINSTRUCTIONS_H\n"
+    "\n"
+    "/*\n"
+    " * SUPERINSTRUCTIONS\n"
+    " *\n"
+    " * Generated by tools/superinstructions.c from opcode pair profiles, run\n"
+    " * make superinstructions instead of editing it.\n"
+    " *\n");
+  if(count > 0) {
+    fprintf(out,
+      " * The pairs the decode cache fuses into one handler, most frequent first,\n"
+      " * with their share of the %llu profiled pairs.\n", (unsigned long long)total);
+  } else {
+    fprintf(out,
+      " * The pairs the decode cache fuses into one handler. Empty until it is\n"
+      " * generated from pair profiles of real programs.\n");
+  }
+  fprintf(out,
+    " */\n"
+    "\n"
+    "#define SUPERINSTRUCTIONS(SUPERINSTRUCTION)");
+
+  for(uint i = 0; i < count; i++) {
+    fprintf(out, " \\\n  SUPERINSTRUCTION(%s, %s) /* %.1f%% */",
+      names[fused[i].first], names[fused[i].second], 100.0 * fused[i].count / total);
+  }
+  fprintf(out, "\n\n#endif\n");
+  return !ferror(out);
+}
+
+int main(int argc, char **argv) {
+  if(argc < 3) {
+    fprintf(stderr, "usage: %s HEADER PAIRS...\n", argv[0]);
+    return 2;
+  }
+
+  for(int i = 2; i < argc; i++) {
+    FILE *in = fopen(argv[i], "r");
+    if(in == NULL) {
+      perror(argv[i]);
+      return 1;
+    }
+    byte ok = readOpcodePairs(pairs, in);
+    fclose(in);
+    if(!ok) {
+      fprintf(stderr, "%s: not a pair profile\n", argv[i]);
+      return 1;
+    }
+  }
+
+  static Pair candidates[256 * 256];
+  uint count = 0;
+  uint64_t total = 0;
+  for(int first = 0; first < 256; first++) {
+    for(int second = 0; second < 256; second++) {
+      total += pairs[first][second];
+      if(pairs[first][second] > 0 && names[first] != NULL && names[second] != NULL)
+        candidates[count++] = (Pair){ first, second, pairs[first][second] };
+    }
+  }
+
+  qsort(candidates, count, sizeof(Pair), comparePairs);
+  uint fused = 0;
+  while(fused < count && fused < FUSED_MAX &&
+      candidates[fused].count >= FUSED_MIN_SHARE * total) {
+    fused++;
+  }
+
+  FILE *out = fopen(argv[1], "w");
+  if(out == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  byte ok = writeHeader(out, candidates, fused, total);
+  if(fclose(out) != 0 || !ok) {
+    perror(argv[1]);
+    return 1;
+  }
+  fprintf(stderr, "%u of %u pairs fused\n", fused, count);
+  return 0;
+}
@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include "../src/trace.h"
+
+// Prints a binary execution trace as text: tracedump trace.bin
+int main(int argc, char **argv) {
+  if(argc != 2) {
+    fprintf(stderr, "usage: %s TRACE\n", argv[0]);
+    return 2;
+  }
+
+  FILE *in = fopen(argv[1], "rb");
+  if(in == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  byte ok = decodeTrace(in, stdout);
+  fclose(in);
+  if(!ok) {
+    fprintf(stderr, "%s: not a trace, or truncated\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
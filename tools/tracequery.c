@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../src/traceindex.h"
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "usage: %s TRACE INDEX build\n"
+    "       %s TRACE INDEX writes|reads|pc ADDRESS\n"
+    "       %s TRACE INDEX state CYCLE\n", name, name, name);
+}
+
+static void printRecord(const TraceState *state, void *context) {
+  printf("%12llu  ", (unsigned long long)state->cycles);
+  writeTraceRecord(stdout, state);
+}
+
+// Hex address, with an optional leading $
+static byte parseAddress(const char *text, word *address) {
+  char *end;
+  if(*text == '$')
+    text++;
+  unsigned long value = strtoul(text, &end, 16);
+  if(*text == '\0' || *end != '\0' || value >= MEMORY_SIZE)
+    return 0;
+  *address = value;
+  return 1;
+}
+
+// Runs a query on an open index, returns the exit status
+static int query(const TraceIndex *index, char **argv) {
+  word address;
+  TraceState state;
+  if(strcmp(argv[3], "state") == 0) {
+    char *end;
+    unsigned long long cycle = strtoull(argv[4], &end, 10);
+    if(*end != '\0' || !findState(index, cycle, &state))
+      return 1;
+    printRecord(&state, NULL);
+  } else if(!parseAddress(argv[4], &address)) {
+    usage(argv[0]);
+    return 2;
+  } else if(strcmp(argv[3], "writes") == 0) {
+    findWrites(index, address, printRecord, NULL);
+  } else if(strcmp(argv[3], "reads") == 0) {
+    findReads(index, address, printRecord, NULL);
+  } else if(strcmp(argv[3], "pc") == 0) {
+    findExecutions(index, address, printRecord, NULL);
+  } else {
+    usage(argv[0]);
+    return 2;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if(argc < 4) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  FILE *trace = fopen(argv[1], "rb");
+  if(trace == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  if(strcmp(argv[3], "build") == 0) {
+    FILE *file = fopen(argv[2], "wb");
+    if(file == NULL) {
+      perror(argv[2]);
+      fclose(trace);
+      return 1;
+    }
+    byte ok = buildTraceIndex(trace, file);
+    ok = fclose(file) == 0 && ok;
+    ok = fclose(trace) == 0 && ok;
+    if(!ok)
+      fprintf(stderr, "%s: not a trace, or truncated\n", argv[1]);
+    return ok ? 0 : 1;
+  }
+
+  FILE *file = fopen(argv[2], "rb");
+  TraceIndex index;
+  if(file == NULL || !openTraceIndex(&index, trace, file)) {
+    fprintf(stderr, "%s: not an index of %s\n", argv[2], argv[1]);
+    if(file != NULL)
+      fclose(file);
+    fclose(trace);
+    return 1;
+  }
+
+  int status = 2;
+  if(argc == 5)
+    status = query(&index, argv);
+  else
+    usage(argv[0]);
+
+  closeTraceIndex(&index);
+  byte closed = fclose(file) == 0;
+  closed = fclose(trace) == 0 && closed;
+  if(!closed) {
+    perror(argv[2]);
+    return 1;
+  }
+  return status;
+}